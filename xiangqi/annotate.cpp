@@ -0,0 +1,333 @@
+//
+//  annotate.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "annotate.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "game_archive.hpp"
+#include "engine.hpp"
+
+constexpr static int _scoreCap = 2000; // beyond this a move is lost or won either way, so mates count no more
+constexpr static int _inaccuracyLoss = 50; // centipawns a move gives up compared to the best one
+constexpr static int _mistakeLoss = 100;
+constexpr static int _blunderLoss = 300;
+constexpr static int _reportSeconds = 10;
+
+// a game being searched, shared by the tasks for its plies and written out by whichever finishes last
+struct PendingGame{
+    uint32_t number;
+    std::vector<Move> moves; // as far as the game could be followed
+    std::vector<GameState> positions; // before each move and the one the game ended in
+    std::vector<SearchResult> results; // by position
+    std::atomic<int> remaining; // positions not searched yet
+};
+
+struct Task{
+    std::shared_ptr<PendingGame> game;
+    int ply;
+};
+
+// the owner takes plies from the front, a thread out of work steals from the back, far from what the owner is on
+class TaskQueue{
+    std::deque<Task> _tasks;
+    std::mutex _mutex;
+
+public:
+    // the last ply comes first, so earlier positions find what was learned about the later ones in the table
+    void pushGame(const std::shared_ptr<PendingGame>& game){
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int ply = static_cast<int>(game->positions.size())-1; ply >= 0; --ply){
+            _tasks.push_back(Task{game, ply});
+        }
+    }
+
+    bool pop(Task& task){
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_tasks.empty()){
+            return false;
+        }
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+        return true;
+    }
+
+    bool steal(Task& task){
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_tasks.empty()){
+            return false;
+        }
+        task = std::move(_tasks.back());
+        _tasks.pop_back();
+        return true;
+    }
+};
+
+// hands out the archive's games in order, skipping those already annotated
+class GameFeed{
+    const GameArchive& _archive;
+    const std::vector<bool>& _done;
+    std::mutex _mutex;
+    uint32_t _block;
+    GameArchive::Cursor _cursor;
+    uint64_t _next; // number of the game the cursor reads next
+
+public:
+    GameFeed(const GameArchive& archive, const std::vector<bool>& done) : _archive(archive), _done(done), _block(0), _cursor(nullptr, nullptr), _next(0){}
+
+    bool next(ArchiveGame& game, uint32_t& number){
+        std::lock_guard<std::mutex> lock(_mutex);
+        while (true){
+            while (!_cursor.next(game)){
+                if (_block == _archive.blockCount()){
+                    return false;
+                }
+                _next = _archive.block(_block).firstGame;
+                _cursor = _archive.games(_block, _block+1);
+                ++_block;
+            }
+            number = static_cast<uint32_t>(_next++);
+            if (!_done[number]){
+                return true;
+            }
+        }
+    }
+};
+
+// appends finished games, picking up after the games of an earlier run
+class AnnotationWriter{
+    FILE* _file;
+    std::mutex _mutex;
+
+public:
+    std::vector<bool> done; // by game number, read from the file when resuming
+
+    AnnotationWriter(const AnnotationWriter&) = delete;
+
+    AnnotationWriter(const char* path, uint64_t gameCount) : _file(nullptr), done(gameCount){
+        constexpr long headerSize = 4 + sizeof(uint32_t) + sizeof(uint64_t);
+        char magic[4];
+        uint32_t version = 0;
+        uint64_t count = 0;
+        FILE* existing = fopen(path, "rb");
+        long size = 0;
+        if (existing != nullptr && (fseek(existing, 0, SEEK_END) != 0 || (size = ftell(existing)) < headerSize)){
+            // a run killed before its header was written starts over
+            fclose(existing);
+            existing = nullptr;
+        }
+        if (existing != nullptr){
+            rewind(existing);
+            if (fread(magic, 1, 4, existing) != 4 || memcmp(magic, "XQAN", 4) != 0 || fread(&version, sizeof(version), 1, existing) != 1 ||
+                version != _annotationVersion || fread(&count, sizeof(count), 1, existing) != 1 || count != gameCount){
+                fclose(existing);
+                throw std::runtime_error(std::string("annotate: ") + path + " is not an annotation of this archive");
+            }
+            // a run that was stopped can leave half a game at the end, it is cut off and done again
+            long end = headerSize;
+            AnnotatedGameHeader header;
+            while (fseek(existing, end, SEEK_SET) == 0 && fread(&header, sizeof(header), 1, existing) == 1 && header.game < gameCount){
+                long next = end + static_cast<long>(sizeof(header) + header.plies*sizeof(MoveAnnotation));
+                if (next > size){
+                    break;
+                }
+                done[header.game] = true;
+                end = next;
+            }
+            fclose(existing);
+            if (truncate(path, end) != 0){
+                throw std::runtime_error(std::string("annotate: Could not truncate ") + path + ": " + strerror(errno));
+            }
+            _file = fopen(path, "ab");
+        }else{
+            _file = fopen(path, "wb");
+            version = _annotationVersion;
+            if (_file != nullptr){
+                bool written = fwrite("XQAN", 1, 4, _file) == 4 && fwrite(&version, sizeof(version), 1, _file) == 1 &&
+                    fwrite(&gameCount, sizeof(gameCount), 1, _file) == 1 && fflush(_file) == 0;
+                if (!written){
+                    int error = errno;
+                    fclose(_file);
+                    throw std::runtime_error(std::string("annotate: Could not write ") + path + ": " + strerror(error));
+                }
+            }
+        }
+        if (_file == nullptr){
+            throw std::runtime_error(std::string("annotate: Could not open ") + path + ": " + strerror(errno));
+        }
+    }
+
+    ~AnnotationWriter(){
+        if (_file != nullptr){
+            fclose(_file);
+        }
+    }
+
+    void write(const AnnotatedGameHeader& header, const std::vector<MoveAnnotation>& annotations){
+        std::lock_guard<std::mutex> lock(_mutex);
+        bool written = fwrite(&header, sizeof(header), 1, _file) == 1 &&
+            fwrite(annotations.data(), sizeof(MoveAnnotation), annotations.size(), _file) == annotations.size() && fflush(_file) == 0;
+        if (!written){
+            throw std::runtime_error(std::string("annotate: Could not write: ") + strerror(errno));
+        }
+    }
+};
+
+// score of a position the game ended in, for the side to move
+static int finalScore(const GameState& state){
+    if (state.checkmate() || state.stalemate() || state.ruling() == Ruling::Loss){
+        return -Engine::_mateScore;
+    }
+    return state.ruling() == Ruling::Win? Engine::_mateScore : 0;
+}
+
+static void annotateGame(const PendingGame& game, AnnotationWriter& writer){
+    std::vector<MoveAnnotation> annotations;
+    for (size_t ply=0; ply<game.moves.size(); ++ply){
+        const SearchResult& before = game.results[ply];
+        Move move = game.moves[ply];
+        int score = std::clamp(before.score, -_scoreCap, _scoreCap);
+        // the best move gives up nothing even if the search after it came back with a different score
+        int playedScore = move == before.bestMove? score : std::clamp(-game.results[ply+1].score, -_scoreCap, _scoreCap);
+        int loss = score - playedScore;
+        Judgement judgement = loss >= _blunderLoss? Judgement::Blunder : loss >= _mistakeLoss? Judgement::Mistake :
+            loss >= _inaccuracyLoss? Judgement::Inaccuracy : Judgement::Good;
+        annotations.push_back(MoveAnnotation{move.raw(), before.bestMove.raw(), static_cast<int16_t>(score), static_cast<int16_t>(playedScore),
+            static_cast<uint8_t>(judgement), static_cast<uint8_t>(std::clamp(before.depth, 0, 255))});
+    }
+    writer.write(AnnotatedGameHeader{game.number, static_cast<uint16_t>(annotations.size()), 0}, annotations);
+}
+
+int runAnnotate(int argc, const char* argv[]){
+    if (argc < 2){
+        throw std::runtime_error("annotate: expected an archive and an output file");
+    }
+    int threads = 0;
+    Limits limits;
+    size_t hashMegabytes = 16;
+    bool hugePages = false;
+    for (int i=2; i<argc; ++i){
+        if (strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+            threads = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--nodes") == 0 && i+1 < argc){
+            limits.nodes = std::strtoull(argv[++i], nullptr, 10);
+        }else if (strcmp(argv[i], "--depth") == 0 && i+1 < argc){
+            limits.depth = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--time") == 0 && i+1 < argc){
+            limits.seconds = std::atof(argv[++i]);
+        }else if (strcmp(argv[i], "--hash") == 0 && i+1 < argc){
+            hashMegabytes = std::strtoull(argv[++i], nullptr, 10);
+        }else if (strcmp(argv[i], "--huge-pages") == 0){
+            hugePages = true;
+        }else{
+            throw std::runtime_error(std::string("annotate: unknown argument ") + argv[i]);
+        }
+    }
+    if (limits.nodes == 0 && limits.depth == 0 && limits.seconds <= 0){
+        limits.nodes = 100000;
+    }
+    if (threads <= 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    GameArchive archive;
+    archive.open(argv[0]);
+    AnnotationWriter writer(argv[1], archive.gameCount());
+    uint64_t skipped = std::count(writer.done.begin(), writer.done.end(), true);
+    GameFeed feed(archive, writer.done);
+    std::vector<TaskQueue> queues(threads);
+    std::atomic<uint64_t> gamesDone(0), positionsDone(0), steals(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> workers;
+    for (int thread=0; thread<threads; ++thread){
+        workers.push_back(std::async(std::launch::async, [&, thread](){
+            Engine engine(hashMegabytes, 1, hugePages);
+            const PendingGame* lastGame = nullptr;
+            ArchiveGame archived;
+            uint32_t number;
+            Task task;
+            while (true){
+                if (!queues[thread].pop(task)){
+                    if (feed.next(archived, number)){
+                        auto game = std::make_shared<PendingGame>();
+                        game->number = number;
+                        GameState state;
+                        if (!archived.fen.empty() && !state.loadFen(archived.fen)){ // nothing to search, written with no moves
+                            annotateGame(*game, writer);
+                            ++gamesDone;
+                            continue;
+                        }
+                        replayGame(archived, state, true, [&game](const GameState& state, Move move){
+                            game->positions.push_back(state);
+                            game->moves.push_back(move);
+                        });
+                        game->positions.push_back(state);
+                        game->results.resize(game->positions.size());
+                        game->remaining = static_cast<int>(game->positions.size());
+                        queues[thread].pushGame(game);
+                        continue;
+                    }
+                    // no games left to start, so the only work there will ever be is in the other queues
+                    bool stolen = false;
+                    for (int other=1; other<threads && !stolen; ++other){
+                        stolen = queues[(thread+other) % threads].steal(task);
+                    }
+                    if (!stolen){
+                        return;
+                    }
+                    ++steals;
+                }
+                PendingGame& game = *task.game;
+                if (&game != lastGame){ // only what was learned about this game is worth keeping
+                    engine.clear();
+                    lastGame = &game;
+                }
+                const GameState& position = game.positions[task.ply];
+                if (task.ply == static_cast<int>(game.moves.size()) && position.gameOver()){
+                    game.results[task.ply] = SearchResult{_nullMove, finalScore(position), 0, 0, 0, 0, 0};
+                }else{
+                    game.results[task.ply] = engine.search(position, limits);
+                }
+                ++positionsDone;
+                if (--game.remaining == 0){ // the last of its positions, the others are all written
+                    annotateGame(game, writer);
+                    ++gamesDone;
+                }
+            }
+        }));
+    }
+    auto report = [&](){
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::fixed << std::setprecision(1) << gamesDone + skipped << '/' << archive.gameCount() << " games, " << positionsDone
+                  << " positions in " << seconds << " s, " << positionsDone / std::max(seconds, 1e-9) << " positions/s, " << steals << " steals\n";
+    };
+    for (std::future<void>& worker : workers){
+        while (worker.wait_for(std::chrono::seconds(_reportSeconds)) == std::future_status::timeout){
+            report();
+        }
+        worker.get();
+    }
+    report();
+    return 0;
+}
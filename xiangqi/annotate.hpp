@@ -0,0 +1,50 @@
+//
+//  annotate.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+// ./main annotate <archive> <out> [--threads <n>, 0 for all cores] [--nodes <n>] [--depth <d>] [--time <seconds>] [--hash <mb>] [--huge-pages]
+// searches the position before every move of every game and the one the game ended in, then judges each move by the score it gave up
+// each thread owns a queue of (game, ply) searches and keeps its transposition table while it works through one game
+// a thread with nothing left takes the next game from the archive and, once there are none, steals plies from the back of another queue
+// games are appended to out as they finish, rerunning with the same out skips the games already in it
+int runAnnotate(int argc, const char* argv[]);
+
+/*
+ annotated games, little endian
+ - file header: "XQAN", uint32_t version, uint64_t number of games in the archive
+ - per game, in the order they finished: AnnotatedGameHeader, then MoveAnnotation[plies]
+ */
+struct AnnotatedGameHeader{
+    uint32_t game; // number in the archive
+    uint16_t plies; // fewer than the game has if it could not be followed to the end
+    uint16_t reserved;
+};
+
+static_assert(sizeof(AnnotatedGameHeader) == 8);
+
+enum class Judgement : uint8_t{
+    Good,
+    Inaccuracy,
+    Mistake,
+    Blunder,
+};
+
+struct MoveAnnotation{
+    uint16_t move; // Move::raw as played
+    uint16_t bestMove; // Move::raw the search preferred
+    int16_t score; // before the move, in centipawns for the side to move
+    int16_t playedScore; // after the move, for the same side
+    uint8_t judgement; // Judgement
+    uint8_t depth; // of the search before the move
+};
+
+static_assert(sizeof(MoveAnnotation) == 10);
+
+constexpr static uint32_t _annotationVersion = 1;
@@ -0,0 +1,87 @@
+//
+//  bench.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "bench.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+
+#include "engine.hpp"
+#include "notation.hpp"
+
+int runBench(int argc, const char* argv[]){
+    int depth = 10;
+    unsigned maxThreads = 0;
+    const char* fen = nullptr;
+    size_t hashMegabytes = 64;
+    bool hugePages = false;
+    for (int i=0; i<argc; ++i){
+        if (strcmp(argv[i], "--depth") == 0 && i+1 < argc){
+            depth = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+            maxThreads = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--fen") == 0 && i+1 < argc){
+            fen = argv[++i];
+        }else if (strcmp(argv[i], "--hash") == 0 && i+1 < argc){
+            hashMegabytes = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--huge-pages") == 0){
+            hugePages = true;
+        }else{
+            throw std::runtime_error(std::string("bench: unknown argument ") + argv[i]);
+        }
+    }
+    if (depth < 1){
+        throw std::runtime_error("bench: depth must be at least 1");
+    }
+    if (maxThreads == 0){
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    GameState root;
+    if (fen != nullptr && !root.loadFen(fen)){
+        throw std::runtime_error("bench: invalid FEN");
+    }
+
+    // 1, 2, 4, ... and the requested count itself if it is not a power of two
+    std::vector<int> threadCounts;
+    for (unsigned threads=1; threads<maxThreads; threads*=2){
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    Engine engine(hashMegabytes, 1, hugePages);
+    double baseSeconds = 0, baseNps = 0;
+    std::cout << "threads     seconds          nodes        nps  time speedup  nps speedup  first cutoff  move  score\n";
+    for (int threads : threadCounts){
+        engine.clear(); // every run starts cold so the times are comparable
+        engine.setThreads(threads);
+        SearchResult result = engine.search(root, Limits{0, depth, 0});
+        double nps = result.nodes / std::max(result.seconds, 1e-9);
+        if (threads == 1){
+            baseSeconds = result.seconds;
+            baseNps = nps;
+        }
+        char iccs[_iccsLength];
+        writeIccs(result.bestMove, iccs);
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(3)
+                  << std::setw(12) << result.seconds
+                  << std::setw(15) << result.nodes
+                  << std::setw(11) << static_cast<uint64_t>(nps)
+                  << std::setprecision(2) << std::setw(13) << baseSeconds / std::max(result.seconds, 1e-9)
+                  << std::setw(13) << nps / baseNps
+                  << std::setw(13) << 100.0 * result.firstMoveCutoffs / std::max<uint64_t>(result.cutoffNodes, 1) << '%'
+                  << "  " << std::string_view(iccs, _iccsLength)
+                  << std::setw(7) << result.score << '\n';
+    }
+    return 0;
+}
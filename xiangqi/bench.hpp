@@ -0,0 +1,12 @@
+//
+//  bench.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+// ./main bench [--depth <d>] [--threads <n>, 0 for all cores] [--fen "<fen>"] [--hash <mb>] [--huge-pages]
+// searches the same position to depth with 1, 2, 4, ... n threads and reports nodes/sec and time to depth
+int runBench(int argc, const char* argv[]);
@@ -0,0 +1,65 @@
+//
+//  bitboard.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+// one bit per square, square = y*9 + x so (0, 0) is bit 0 and each rank is 9 consecutive bits
+using Bitboard = unsigned __int128;
+
+constexpr static int _boardFiles = 9;
+constexpr static int _boardRanks = 10;
+constexpr static int _squareCount = _boardFiles*_boardRanks;
+
+constexpr static Bitboard _emptyBitboard = 0;
+constexpr static Bitboard _fullBitboard = (Bitboard{1} << _squareCount) - 1;
+
+constexpr int squareOf(int x, int y){
+    return y*_boardFiles + x;
+}
+
+constexpr int fileOf(int square){
+    return square % _boardFiles;
+}
+
+constexpr int rankOf(int square){
+    return square / _boardFiles;
+}
+
+constexpr bool onBoard(int x, int y){
+    return x >= 0 && x < _boardFiles && y >= 0 && y < _boardRanks;
+}
+
+constexpr Bitboard squareBit(int square){
+    return Bitboard{1} << square;
+}
+
+// bit of square in a file-major board where square (x, y) is bit x*10 + y, so each file is 10 consecutive bits
+constexpr Bitboard rotatedBit(int square){
+    return Bitboard{1} << (fileOf(square)*_boardRanks + rankOf(square));
+}
+
+constexpr bool testBit(Bitboard bb, int square){
+    return (bb >> square) & 1;
+}
+
+inline int lsb(Bitboard bb){
+    uint64_t low = static_cast<uint64_t>(bb);
+    return low != 0? __builtin_ctzll(low) : 64 + __builtin_ctzll(static_cast<uint64_t>(bb >> 64));
+}
+
+// removes and returns the lowest set square, bb must not be empty
+inline int popLsb(Bitboard& bb){
+    int square = lsb(bb);
+    bb &= bb - 1;
+    return square;
+}
+
+inline int popCount(Bitboard bb){
+    return __builtin_popcountll(static_cast<uint64_t>(bb)) + __builtin_popcountll(static_cast<uint64_t>(bb >> 64));
+}
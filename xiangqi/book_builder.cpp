@@ -0,0 +1,351 @@
+//
+//  book_builder.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "book_builder.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "game_logic.hpp"
+#include "opening_book.hpp"
+#include "notation.hpp"
+
+// weights are summed in 32 bits while sorting and scaled into the book's 16 bits at the end
+struct RunEntry{
+    uint64_t key;
+    uint32_t weight;
+    uint16_t move;
+};
+
+static bool operator<(const RunEntry& a, const RunEntry& b){
+    return a.key != b.key? a.key < b.key : a.move < b.move;
+}
+
+constexpr static size_t _maxMergeWays = 128; // runs merged at once, each reading its own block
+constexpr static size_t _mergeBufferSize = 4096; // entries written at a time by a merge pass
+
+// sorted runs back to back in one temporary file, so there can be any number of them without running out of open files
+class RunFile{
+    FILE* _file;
+    uint64_t _size; // entries
+
+public:
+    RunFile(const RunFile&) = delete;
+
+    RunFile() : _file(std::tmpfile()), _size(0){
+        if (_file == nullptr){
+            throw std::runtime_error(std::string("book: Could not create a temporary file: ") + strerror(errno));
+        }
+    }
+
+    ~RunFile(){
+        fclose(_file); // tmpfile removes itself
+    }
+
+    void append(const RunEntry* entries, size_t count){
+        if (fwrite(entries, sizeof(RunEntry), count, _file) != count){
+            throw std::runtime_error(std::string("book: Could not write a temporary run: ") + strerror(errno));
+        }
+        _size += count;
+    }
+
+    uint64_t size() const{
+        return _size;
+    }
+
+    // called once everything is appended, before any run is read
+    int finish(){
+        if (fflush(_file) != 0){
+            throw std::runtime_error(std::string("book: Could not write a temporary run: ") + strerror(errno));
+        }
+        return fileno(_file);
+    }
+};
+
+struct RunSpan{
+    uint64_t first; // entry in its RunFile
+    uint64_t count;
+};
+
+// a run read back a block at a time during a merge
+class Run{
+    constexpr static size_t _blockSize = 4096;
+
+    int _fd;
+    uint64_t _next, _end; // entries in the file
+    std::vector<RunEntry> _block;
+    size_t _read;
+
+public:
+    Run(int fd, RunSpan span) : _fd(fd), _next(span.first), _end(span.first + span.count), _read(0){}
+
+    bool read(RunEntry& entry){
+        if (_read == _block.size()){
+            size_t count = static_cast<size_t>(std::min<uint64_t>(_blockSize, _end - _next));
+            if (count == 0){
+                return false;
+            }
+            _block.resize(count);
+            size_t bytes = count*sizeof(RunEntry);
+            off_t offset = static_cast<off_t>(_next*sizeof(RunEntry));
+            for (size_t done = 0; done < bytes;){
+                ssize_t got = pread(_fd, reinterpret_cast<char*>(_block.data()) + done, bytes - done, offset + done);
+                if (got <= 0){ // the run was written whole, so running out early is an error too
+                    throw std::runtime_error(std::string("book: Could not read a temporary run: ") + (got == 0? "unexpected end of file" : strerror(errno)));
+                }
+                done += got;
+            }
+            _next += count;
+            _read = 0;
+        }
+        entry = _block[_read++];
+        return true;
+    }
+};
+
+// calls visit(entry) for the entries of runs [first, last) in sorted order, the same move of a key from different runs added up
+template<typename Visit>
+static void mergeRuns(int fd, const std::vector<RunSpan>& spans, size_t first, size_t last, Visit&& visit){
+    std::vector<Run> runs;
+    for (size_t i=first; i<last; ++i){
+        runs.emplace_back(fd, spans[i]);
+    }
+    using Head = std::pair<RunEntry, size_t>; // next entry of a run and which run
+    auto later = [](const Head& a, const Head& b){
+        return b.first < a.first;
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+    for (size_t i=0; i<runs.size(); ++i){
+        RunEntry entry;
+        if (runs[i].read(entry)){
+            heads.emplace(entry, i);
+        }
+    }
+    RunEntry pending{};
+    bool havePending = false;
+    while (!heads.empty()){
+        auto [entry, run] = heads.top();
+        heads.pop();
+        RunEntry next;
+        if (runs[run].read(next)){
+            heads.emplace(next, run);
+        }
+        if (havePending && pending.key == entry.key && pending.move == entry.move){
+            pending.weight = static_cast<uint32_t>(std::min<uint64_t>(uint64_t{pending.weight} + entry.weight, std::numeric_limits<uint32_t>::max()));
+            continue;
+        }
+        if (havePending){
+            visit(pending);
+        }
+        pending = entry;
+        havePending = true;
+    }
+    if (havePending){
+        visit(pending);
+    }
+}
+
+// sorts entries, adds up duplicates and appends them to the run file as one run
+static RunSpan writeRun(std::vector<RunEntry>& entries, RunFile& runFile){
+    std::sort(entries.begin(), entries.end());
+    size_t size = 0;
+    for (const RunEntry& entry : entries){
+        if (size > 0 && entries[size-1].key == entry.key && entries[size-1].move == entry.move){
+            entries[size-1].weight += entry.weight;
+        }else{
+            entries[size++] = entry;
+        }
+    }
+    RunSpan span{runFile.size(), size};
+    runFile.append(entries.data(), size);
+    entries.clear();
+    return span;
+}
+
+// scales one position's moves into 16 bits, drops those that never scored and writes them best first
+static void writePosition(uint64_t key, std::vector<RunEntry>& moves, FILE* out, size_t& written){
+    uint32_t maxWeight = 0;
+    for (const RunEntry& move : moves){
+        maxWeight = std::max(maxWeight, move.weight);
+    }
+    std::sort(moves.begin(), moves.end(), [](const RunEntry& a, const RunEntry& b){
+        return a.weight != b.weight? a.weight > b.weight : a.move < b.move;
+    });
+    constexpr uint32_t limit = std::numeric_limits<uint16_t>::max();
+    for (const RunEntry& move : moves){
+        if (move.weight == 0){
+            break;
+        }
+        uint32_t weight = maxWeight > limit? std::max<uint32_t>(1, static_cast<uint64_t>(move.weight)*limit / maxWeight) : move.weight;
+        BookEntry entry{key, move.move, static_cast<uint16_t>(weight), 0};
+        if (fwrite(&entry, sizeof(BookEntry), 1, out) != 1){
+            throw std::runtime_error(std::string("book: Could not write the book: ") + strerror(errno));
+        }
+        ++written;
+    }
+    moves.clear();
+}
+
+int runBookBuilder(int argc, const char* argv[]){
+    if (argc < 2){
+        throw std::runtime_error("book: expected <games> <book>");
+    }
+    const char* gamesPath = argv[0];
+    const char* bookPath = argv[1];
+    int maxPlies = 30;
+    size_t memoryMegabytes = 256;
+    for (int i=2; i<argc; ++i){
+        if (strcmp(argv[i], "--plies") == 0 && i+1 < argc){
+            maxPlies = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--memory") == 0 && i+1 < argc){
+            memoryMegabytes = std::atoi(argv[++i]);
+        }else{
+            throw std::runtime_error(std::string("book: unknown argument ") + argv[i]);
+        }
+    }
+    if (maxPlies < 1){
+        throw std::runtime_error("book: plies must be at least 1");
+    }
+    if (memoryMegabytes < 1){
+        throw std::runtime_error("book: memory must be at least 1 MB");
+    }
+    std::ifstream games(gamesPath);
+    if (!games){
+        throw std::runtime_error(std::string("book: Could not open ") + gamesPath);
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    // pass 1: stream the games into sorted runs
+    size_t runCapacity = memoryMegabytes*1024*1024 / sizeof(RunEntry);
+    std::vector<RunEntry> entries;
+    entries.reserve(runCapacity);
+    auto runFile = std::make_unique<RunFile>();
+    std::vector<RunSpan> spans;
+    size_t gameCount = 0, cutShort = 0;
+    std::string line;
+    std::vector<std::string_view> tokens;
+    GameState state;
+    while (std::getline(games, line)){
+        tokens.clear();
+        for (size_t i=0; i<line.size();){
+            size_t end = line.find_first_of(" \t\r", i);
+            end = end == std::string::npos? line.size() : end;
+            if (end > i){
+                tokens.emplace_back(line.data()+i, end-i);
+            }
+            i = end+1;
+        }
+        if (tokens.empty()){
+            continue;
+        }
+        // weight for red and for black
+        uint32_t weights[2]{1, 1};
+        if (tokens.back() == "1-0"){
+            weights[0] = 2;
+            weights[1] = 0;
+        }else if (tokens.back() == "0-1"){
+            weights[0] = 0;
+            weights[1] = 2;
+        }
+        ++gameCount;
+        state.reset();
+        for (int ply=0; ply<static_cast<int>(tokens.size()) && ply<maxPlies; ++ply){
+            Move move;
+            if (!parseIccs(tokens[ply], move)){ // the result
+                break;
+            }
+            if (!state.isLegal(move)){ // the rest of the game cannot be followed
+                ++cutShort;
+                break;
+            }
+            entries.push_back(RunEntry{state.hash(), weights[static_cast<int>(state.currentTurn())], move.raw()});
+            if (entries.size() == runCapacity){
+                spans.push_back(writeRun(entries, *runFile));
+            }
+            state.performMove(move);
+        }
+    }
+    if (games.bad()){
+        throw std::runtime_error(std::string("book: Could not read ") + gamesPath);
+    }
+    if (!entries.empty()){
+        spans.push_back(writeRun(entries, *runFile));
+    }
+    entries.shrink_to_fit();
+    size_t runCount = spans.size();
+
+    // merge passes until few enough runs are left to merge them all at once, each pass merging groups of that many into one
+    int mergePasses = 0;
+    while (spans.size() > _maxMergeWays){
+        auto merged = std::make_unique<RunFile>();
+        std::vector<RunSpan> mergedSpans;
+        std::vector<RunEntry> buffer;
+        int fd = runFile->finish();
+        for (size_t first=0; first<spans.size(); first+=_maxMergeWays){
+            uint64_t start = merged->size();
+            mergeRuns(fd, spans, first, std::min(first + _maxMergeWays, spans.size()), [&](const RunEntry& entry){
+                buffer.push_back(entry);
+                if (buffer.size() == _mergeBufferSize){
+                    merged->append(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            });
+            merged->append(buffer.data(), buffer.size());
+            buffer.clear();
+            mergedSpans.push_back(RunSpan{start, merged->size() - start});
+        }
+        runFile = std::move(merged); // the runs it merged are deleted with it
+        spans = std::move(mergedSpans);
+        ++mergePasses;
+    }
+
+    // pass 2: merge the runs, adding up the same move from different runs
+    FILE* out = fopen(bookPath, "wb");
+    if (out == nullptr){
+        throw std::runtime_error(std::string("book: Could not create ") + bookPath + ": " + strerror(errno));
+    }
+    std::vector<RunEntry> position; // moves of the key being merged
+    size_t positionCount = 0, written = 0;
+    mergeRuns(runFile->finish(), spans, 0, spans.size(), [&](const RunEntry& entry){
+        if (!position.empty() && position.back().key != entry.key){
+            writePosition(position.back().key, position, out, written);
+            ++positionCount;
+        }
+        position.push_back(entry);
+    });
+    if (!position.empty()){
+        writePosition(position.back().key, position, out, written);
+        ++positionCount;
+    }
+    runFile.reset();
+    if (fclose(out) != 0){
+        throw std::runtime_error(std::string("book: Could not write the book: ") + strerror(errno));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << gameCount << " games, " << positionCount << " positions, " << written << " entries from "
+              << runCount << " sorted runs and " << mergePasses << " extra merge passes in " << seconds << " s";
+    if (cutShort > 0){
+        std::cout << ", " << cutShort << " games cut short at an illegal move";
+    }
+    std::cout << '\n';
+    return 0;
+}
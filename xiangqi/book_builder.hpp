@@ -0,0 +1,15 @@
+//
+//  book_builder.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+// ./main book <games> <book> [--plies <n>] [--memory <mb>]
+// games is a text file with one game per line, ICCS moves separated by spaces and optionally a result (1-0, 0-1, 1/2-1/2) at the end
+// every move in the first n plies of a game counts 2 for a win, 1 for a draw or unknown result and 0 for a loss of the side that played it
+// entries are sorted in runs of at most mb megabytes in a temporary file and merged, so the games can be bigger than memory,
+// more than 128 runs take extra merge passes
+int runBookBuilder(int argc, const char* argv[]);
@@ -0,0 +1,381 @@
+//
+//  engine.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "engine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <future>
+#include <thread>
+#include <cstdlib>
+
+#include "evaluation.hpp"
+#include "move_picker.hpp"
+#include "tablebase.hpp"
+
+constexpr static int _infinity = Engine::_mateScore + 1;
+constexpr static int _mateBound = Engine::_mateScore - Engine::_maxPly; // anything beyond is a mate score
+constexpr static int _aspirationWindow = 50;
+constexpr static int _historyLimit = 1 << 20;
+
+// mate scores are stored relative to the node so they stay correct when reached at another ply
+static int scoreToTable(int score, int ply){
+    return score >= _mateBound? score + ply : score <= -_mateBound? score - ply : score;
+}
+
+static int scoreFromTable(int score, int ply){
+    return score >= _mateBound? score - ply : score <= -_mateBound? score + ply : score;
+}
+
+// one search thread, everything but the transposition table is its own so threads never contend
+class Engine::Worker{
+    Engine& _engine;
+    int _index; // 0 is the main thread which decides the result, the rest are helpers
+    GameState _state;
+    Limits _limits;
+    std::chrono::steady_clock::time_point _start;
+    uint64_t _nodes, _reportedNodes;
+    uint64_t _cutoffNodes, _firstMoveCutoffs; // how often the first move tried was already good enough
+    bool _stopped;
+    int _rootDepth, _completedDepth;
+    Move _rootBest;
+    Move _killers[_maxPly][2];
+    int _history[_squareCount][_squareCount]; // [from][to], bumped by quiet moves that cause a cutoff
+
+public:
+    Worker(Engine& engine, int index, const GameState& state, Limits limits) : _engine(engine), _index(index), _state(state), _limits(limits), _start(std::chrono::steady_clock::now()), _nodes(0), _reportedNodes(0), _cutoffNodes(0), _firstMoveCutoffs(0), _stopped(false), _rootDepth(0), _completedDepth(0), _killers{}, _history{}{}
+
+    SearchResult run();
+
+private:
+    double elapsed() const{
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    void reportNodes(){
+        _engine._nodes.fetch_add(_nodes - _reportedNodes, std::memory_order_relaxed);
+        _reportedNodes = _nodes;
+    }
+
+    // limits are checked every 1024 nodes against the total of all threads
+    // the main thread always finishes its first iteration so there is a move to play
+    bool shouldStop(){
+        if (_stopped){
+            return true;
+        }
+        if ((_nodes & 1023) == 0 && _nodes != _reportedNodes){
+            reportNodes();
+            if ((_limits.nodes != 0 && _engine._nodes.load(std::memory_order_relaxed) >= _limits.nodes) || (_limits.seconds > 0 && elapsed() >= _limits.seconds)){
+                _engine._stop = true;
+            }
+        }
+        if (_index == 0 && _completedDepth == 0){
+            return false;
+        }
+        _stopped = _engine._stop.load(std::memory_order_relaxed);
+        return _stopped;
+    }
+
+    void updateQuietCutoff(Move move, int depth, int ply){
+        if (move != _killers[ply][0]){
+            _killers[ply][1] = _killers[ply][0];
+            _killers[ply][0] = move;
+        }
+        int& history = _history[move.from()][move.to()];
+        history += depth*depth;
+        if (history > _historyLimit){
+            for (auto& row : _history){
+                for (int& value : row){
+                    value /= 2;
+                }
+            }
+        }
+    }
+
+    bool hasMajorPieces(Side side) const{
+        return (_state.occupancy(side, PieceType::Ju) | _state.occupancy(side, PieceType::Ma) | _state.occupancy(side, PieceType::Pao)) != 0;
+    }
+
+    int quiescence(int alpha, int beta, int ply);
+
+    int search(int alpha, int beta, int depth, int ply, bool allowNull);
+};
+
+SearchResult Engine::Worker::run(){
+    SearchResult result{_nullMove, 0, 0, 0, 0, 0, 0};
+    MoveList rootMoves;
+    _state.generateLegalMoves(_state.currentTurn(), rootMoves);
+    if (rootMoves.empty()){ // no legal moves loses
+        result.score = -_mateScore;
+        return result;
+    }
+    result.bestMove = rootMoves[0];
+    int maxDepth = _limits.depth > 0? std::min(_limits.depth, _maxPly-1) : _maxPly-1;
+    int score = 0;
+    // odd helpers run one ply ahead so the threads spread over two depths and fill the table for each other
+    for (int iteration=1; _completedDepth<maxDepth; ++iteration){
+        _rootDepth = std::min(iteration + (_index & 1), maxDepth);
+        // aspiration window around the last score, widened on each fail
+        int window = _aspirationWindow;
+        int alpha = _rootDepth >= 4? std::max(score - window, -_infinity) : -_infinity;
+        int beta = _rootDepth >= 4? std::min(score + window, _infinity) : _infinity;
+        while (true){
+            int value = search(alpha, beta, _rootDepth, 0, false);
+            if (_stopped){
+                break;
+            }
+            window *= 2;
+            if (value <= alpha){
+                alpha = std::max(value - window, -_infinity);
+            }else if (value >= beta){
+                beta = std::min(value + window, _infinity);
+            }else{
+                score = value;
+                break;
+            }
+        }
+        if (_stopped){
+            break;
+        }
+        _completedDepth = _rootDepth;
+        result.bestMove = _rootBest;
+        result.score = score;
+        result.depth = _rootDepth;
+        if (std::abs(score) >= _mateBound && _mateScore - std::abs(score) <= _rootDepth){ // mate found within full width
+            break;
+        }
+        if (_index == 0 && _limits.seconds > 0 && elapsed() > _limits.seconds/2){ // next iteration would not finish
+            break;
+        }
+    }
+    reportNodes();
+    result.nodes = _nodes;
+    result.seconds = elapsed();
+    result.cutoffNodes = _cutoffNodes;
+    result.firstMoveCutoffs = _firstMoveCutoffs;
+    return result;
+}
+
+int Engine::Worker::quiescence(int alpha, int beta, int ply){
+    if (shouldStop()){
+        return 0;
+    }
+    ++_nodes;
+    if (ply >= _maxPly-1){
+        return evaluate(_state);
+    }
+    bool inCheck = _state.inCheck(_state.currentTurn());
+    int bestScore = -_infinity;
+    if (!inCheck){
+        bestScore = evaluate(_state); // standing pat
+        if (bestScore >= beta){
+            return bestScore;
+        }
+        alpha = std::max(alpha, bestScore);
+    }
+    MovePicker picker(_state, inCheck, _history);
+    int moveCount = 0;
+    for (Move move = picker.next(); !move.isNull(); move = picker.next()){
+        ++moveCount;
+        _state.makeMove(move);
+        int score = -quiescence(-beta, -alpha, ply+1);
+        _state.unmakeMove();
+        if (_stopped){
+            return 0;
+        }
+        if (score > bestScore){
+            bestScore = score;
+            if (score > alpha){
+                alpha = score;
+                if (score >= beta){
+                    break;
+                }
+            }
+        }
+    }
+    if (inCheck && moveCount == 0){ // every evasion has been looked at
+        return -_mateScore + ply;
+    }
+    return bestScore;
+}
+
+int Engine::Worker::search(int alpha, int beta, int depth, int ply, bool allowNull){
+    if (depth <= 0){
+        return quiescence(alpha, beta, ply);
+    }
+    if (shouldStop()){
+        return 0;
+    }
+    ++_nodes;
+    if (ply >= _maxPly-1){
+        return evaluate(_state);
+    }
+    // the first repetition is scored as if the game went on to be ruled on it
+    if (ply > 0){
+        Ruling ruling = _state.judgeRepetition(1);
+        if (ruling != Ruling::None){
+            return ruling == Ruling::Draw? 0 : ruling == Ruling::Win? _mateScore - ply : -_mateScore + ply;
+        }
+        int wdl, plies;
+        if (probeTablebase(_state, wdl, plies)){ // exact, no need to search further
+            return wdl == 0? 0 : wdl > 0? _mateScore - ply - plies : -_mateScore + ply + plies;
+        }
+    }
+    bool pvNode = beta - alpha > 1;
+    Side side = _state.currentTurn();
+    bool inCheck = _state.inCheck(side);
+    // no line can do better than mating right now
+    alpha = std::max(alpha, -_mateScore + ply);
+    beta = std::min(beta, _mateScore - ply - 1);
+    if (alpha >= beta){
+        return alpha;
+    }
+    TableEntry entry;
+    Move tableMove = _nullMove;
+    if (_engine._table.probe(_state.hash(), entry)){
+        tableMove = entry.move;
+        int score = scoreFromTable(entry.score, ply);
+        if (!pvNode && entry.depth >= depth && (entry.bound == Bound::Exact || (entry.bound == Bound::Lower && score >= beta) || (entry.bound == Bound::Upper && score <= alpha))){
+            return score;
+        }
+    }
+    // null move pruning, skipped without ju/ma/pao where passing could be the best move
+    if (allowNull && !pvNode && !inCheck && depth >= 3 && hasMajorPieces(side) && evaluate(_state) >= beta){
+        int reduction = 2 + depth/4;
+        _state.makeNullMove();
+        int score = -search(-beta, -beta+1, depth-1-reduction, ply+1, false);
+        _state.unmakeMove();
+        if (_stopped){
+            return 0;
+        }
+        if (score >= beta){
+            return score >= _mateBound? beta:score;
+        }
+    }
+    if (inCheck){ // check extension
+        ++depth;
+    }
+    MovePicker picker(_state, inCheck, tableMove, _killers[ply], _history);
+    int originalAlpha = alpha;
+    int bestScore = -_infinity;
+    Move bestMove = _nullMove;
+    int moveCount = 0;
+    for (Move move = picker.next(); !move.isNull(); move = picker.next()){
+        bool capture = _state.pieceAt(move.to()) != nullptr;
+        _state.makeMove(move);
+        bool givesCheck = _state.inCheck(_state.currentTurn());
+        int score;
+        if (moveCount++ == 0){
+            score = -search(-beta, -alpha, depth-1, ply+1, true);
+        }else{
+            // late quiet moves are searched shallower first, everything after the first with a null window
+            int reduction = 0;
+            if (depth >= 3 && moveCount > 3 && !capture && !inCheck && !givesCheck){
+                reduction = depth >= 6 && moveCount > 8? 2:1;
+            }
+            score = -search(-alpha-1, -alpha, depth-1-reduction, ply+1, true);
+            if (score > alpha && reduction > 0){
+                score = -search(-alpha-1, -alpha, depth-1, ply+1, true);
+            }
+            if (score > alpha && score < beta){
+                score = -search(-beta, -alpha, depth-1, ply+1, true);
+            }
+        }
+        _state.unmakeMove();
+        if (_stopped){
+            return 0;
+        }
+        if (score > bestScore){
+            bestScore = score;
+            bestMove = move;
+            if (ply == 0){
+                _rootBest = move;
+            }
+            if (score > alpha){
+                alpha = score;
+                if (score >= beta){
+                    ++_cutoffNodes;
+                    _firstMoveCutoffs += moveCount == 1;
+                    if (!capture){
+                        updateQuietCutoff(move, depth, ply);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    if (moveCount == 0){ // checkmate or stalemate, both lose
+        return -_mateScore + ply;
+    }
+    Bound bound = bestScore >= beta? Bound::Lower : bestScore > originalAlpha? Bound::Exact : Bound::Upper;
+    _engine._table.store(_state.hash(), bestMove, scoreToTable(bestScore, ply), depth, bound);
+    return bestScore;
+}
+
+Engine::Engine(size_t hashMegabytes, int threads, bool hugePages) : _table(hashMegabytes, hugePages), _threads(1), _stop(false), _stops(0), _nodes(0){
+    setThreads(threads);
+}
+
+SearchResult Engine::search(const GameState& state, Limits limits){
+    return search(state, limits, _stops);
+}
+
+SearchResult Engine::search(const GameState& state, Limits limits, uint64_t stops){
+    // stop counts before it sets the flag, so a stop that comes after the count is read still lands after the flag is cleared
+    _stop = false;
+    if (_stops != stops){
+        _stop = true;
+    }
+    _nodes = 0;
+    _table.newSearch();
+    // workers are too big for small thread stacks
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i=0; i<_threads; ++i){
+        workers.push_back(std::make_unique<Worker>(*this, i, state, limits));
+    }
+    std::vector<std::future<SearchResult>> helpers;
+    for (int i=1; i<_threads; ++i){
+        helpers.push_back(std::async(std::launch::async, [&workers, i](){ return workers[i]->run(); }));
+    }
+    SearchResult result = workers[0]->run();
+    _stop = true;
+    for (std::future<SearchResult>& helper : helpers){
+        SearchResult helperResult = helper.get();
+        if (helperResult.depth > result.depth){ // a helper finished a deeper iteration
+            result.bestMove = helperResult.bestMove;
+            result.score = helperResult.score;
+            result.depth = helperResult.depth;
+        }
+        result.cutoffNodes += helperResult.cutoffNodes;
+        result.firstMoveCutoffs += helperResult.firstMoveCutoffs;
+    }
+    result.nodes = _nodes;
+    return result;
+}
+
+void Engine::setThreads(int threads){
+    _threads = threads > 0? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+int Engine::threads() const{
+    return _threads;
+}
+
+uint64_t Engine::stopCount() const{
+    return _stops;
+}
+
+void Engine::stop(){
+    ++_stops;
+    _stop = true;
+}
+
+void Engine::clear(){
+    _table.clear();
+}
@@ -0,0 +1,74 @@
+//
+//  engine.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "game_logic.hpp"
+#include "transposition_table.hpp"
+
+// a search stops at whichever limit is reached first, 0 means no limit
+struct Limits{
+    double seconds = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+};
+
+struct SearchResult{
+    Move bestMove; // null if the side to move has no legal moves
+    int score; // centipawns for the side to move
+    int depth; // last completed iteration
+    uint64_t nodes; // all threads
+    double seconds;
+    // nodes that failed high and how many of them on the first move tried, a measure of move ordering
+    uint64_t cutoffNodes, firstMoveCutoffs;
+};
+
+// principal variation alpha-beta with iterative deepening, aspiration windows, null move pruning and late move reductions
+// lazy SMP: every thread searches its own copy of the root, they only share the transposition table
+class Engine{
+public:
+    constexpr static int _mateScore = 30000; // mate in n plies scores _mateScore - n
+    constexpr static int _maxPly = 128;
+
+private:
+    class Worker;
+
+    TranspositionTable _table;
+    int _threads;
+    std::atomic<bool> _stop;
+    std::atomic<uint64_t> _stops; // calls to stop so far
+    std::atomic<uint64_t> _nodes; // searched so far by all threads, reported in batches
+
+public:
+    Engine(const Engine&) = delete;
+
+    // 0 threads uses every core, huge pages back the table where the system has them
+    Engine(size_t hashMegabytes = 16, int threads = 1, bool hugePages = false);
+
+    Engine& operator=(const Engine&) = delete;
+
+    // blocks until a limit is reached or stop is called from another thread
+    SearchResult search(const GameState& state, Limits limits);
+
+    // also returns at once if stop was called since stopCount returned stops, so a stop between taking a position and searching it is not lost
+    SearchResult search(const GameState& state, Limits limits, uint64_t stops);
+
+    uint64_t stopCount() const;
+
+    void stop();
+
+    // not thread safe, only between searches, 0 uses every core
+    void setThreads(int threads);
+
+    int threads() const;
+
+    // forget everything learned from earlier searches
+    void clear();
+};
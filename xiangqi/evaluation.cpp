@@ -0,0 +1,91 @@
+//
+//  evaluation.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "evaluation.hpp"
+
+#include <algorithm>
+
+// per reachable square, relative to a typical count so an average piece scores about 0
+constexpr static int _mobilityMidgame[7]{0, 0, 0, 12, 6, 4, 0}; // indexed by PieceType
+constexpr static int _mobilityEndgame[7]{0, 0, 0, 12, 8, 3, 0};
+constexpr static int _mobilityBase[7]{0, 0, 0, 4, 8, 6, 0};
+
+// pieces whose moves reach into the enemy palace, weighted by type
+constexpr static int _palaceAttackWeights[7]{0, 0, 0, 2, 3, 2, 1};
+constexpr static int _missingGuardPenalty = 6; // per attack unit per missing shi or xiang
+constexpr static int _hollowPaoPenalty = 60; // enemy pao on the shuai's file with nothing between
+
+constexpr static Bitboard makePalace(int side){
+    Bitboard palace = _emptyBitboard;
+    for (int square=0; square<_squareCount; ++square){
+        if (inPalace(side, fileOf(square), rankOf(square))){
+            palace |= squareBit(square);
+        }
+    }
+    return palace;
+}
+
+constexpr static Bitboard _palaces[2]{makePalace(0), makePalace(1)};
+
+constexpr static Bitboard makeFile(int x){
+    Bitboard file = _emptyBitboard;
+    for (int y=0; y<_boardRanks; ++y){
+        file |= squareBit(squareOf(x, y));
+    }
+    return file;
+}
+
+constexpr static Bitboard _files[_boardFiles]{makeFile(0), makeFile(1), makeFile(2), makeFile(3), makeFile(4), makeFile(5), makeFile(6), makeFile(7), makeFile(8)};
+
+// mobility of side's ju, ma and pao, and how much of that reaches the enemy palace
+static void evaluatePieces(const GameState& state, Side side, int& midgame, int& endgame, int& palaceAttack){
+    const Bitboard enemyPalace = _palaces[static_cast<int>(otherSide(side))];
+    for (PieceType type : {PieceType::Ma, PieceType::Ju, PieceType::Pao}){
+        int t = static_cast<int>(type);
+        Bitboard pieces = state.occupancy(side, type);
+        while (pieces){
+            Bitboard targets = state.pieceTargets(popLsb(pieces));
+            int mobility = popCount(targets) - _mobilityBase[t];
+            midgame += _mobilityMidgame[t] * mobility;
+            endgame += _mobilityEndgame[t] * mobility;
+            if (targets & enemyPalace){
+                palaceAttack += _palaceAttackWeights[t];
+            }
+        }
+    }
+    palaceAttack += _palaceAttackWeights[static_cast<int>(PieceType::Bing)] * popCount(state.occupancy(side, PieceType::Bing) & enemyPalace);
+}
+
+// danger to side's shuai, only matters while there is material to attack with
+static int palacePenalty(const GameState& state, Side side, int attack){
+    Side enemy = otherSide(side);
+    int guards = popCount(state.occupancy(side, PieceType::Shi) | state.occupancy(side, PieceType::Xiang));
+    int penalty = attack*attack*2 + attack*(4 - guards)*_missingGuardPenalty;
+    int shuai = state.shuaiSquare(side);
+    if (state.juAttacks(shuai) & state.occupancy(enemy, PieceType::Pao) & _files[fileOf(shuai)]){
+        penalty += _hollowPaoPenalty;
+    }
+    return penalty;
+}
+
+int evaluate(const GameState& state){
+    if (_network != nullptr){
+        return evaluateNetwork(state.accumulator(state.currentTurn()), state.accumulator(otherSide(state.currentTurn())));
+    }
+    int midgame = state.midgameScore(), endgame = state.endgameScore();
+    int redMidgame = 0, redEndgame = 0, redAttack = 0;
+    int blackMidgame = 0, blackEndgame = 0, blackAttack = 0;
+    evaluatePieces(state, Side::Red, redMidgame, redEndgame, redAttack);
+    evaluatePieces(state, Side::Black, blackMidgame, blackEndgame, blackAttack);
+    midgame += redMidgame - blackMidgame;
+    endgame += redEndgame - blackEndgame;
+    midgame += palacePenalty(state, Side::Black, redAttack) - palacePenalty(state, Side::Red, blackAttack);
+    // blend by how much material is left
+    int phase = std::min(state.phase(), _maxPhase);
+    int score = (midgame*phase + endgame*(_maxPhase - phase)) / _maxPhase;
+    return state.currentTurn() == Side::Red? score:-score;
+}
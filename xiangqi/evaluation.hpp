@@ -0,0 +1,14 @@
+//
+//  evaluation.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include "game_logic.hpp"
+
+// static score in centipawns for the side to move, from the network if one is loaded
+// otherwise material and piece-square terms come incrementally from GameState, mobility and king safety are computed here
+int evaluate(const GameState& state);
@@ -45,6 +45,19 @@ constexpr static int _boardHeight = _boxSize*9 + _boardMargin*2;
 constexpr static int _screenWidth = _boardWidth+_sidebarWidth;
 constexpr static int _screenHeight = _boardHeight+_bottomBarHeight;
 
+/* COMPUTER */
+constexpr static double _computerThinkSeconds = 2;
+
+/* OPENING BOOK */
+constexpr static char _bookPath[] = "assets/xiangqi.book";
+constexpr static SDL_Color _bookMoveColor{0, 120, 200, SDL_ALPHA_OPAQUE};
+
+/* EXPLORER */
+constexpr static char _indexPath[] = "assets/xiangqi.index";
+constexpr static int _smallFontSize = 18;
+constexpr static int _explorerLineHeight = 26;
+constexpr static int _explorerMoves = 20;
+
 Game::PixelPos::PixelPos() = default;
 
 Game::PixelPos::PixelPos(int x, int y) : x(x), y(y){}
@@ -85,7 +98,7 @@ void Game::Button::render(SDL_Renderer* renderer, TTF_Font* font) const{
     drawText(renderer, font, _confirmState? _confirmText.c_str():_text.c_str(), PixelPos{_rect.x + _rect.w/2, _rect.y + _rect.h/2}, _borderColor);
 }
 
-Game::Game(const char* address, int port, bool ipv6) : _window(nullptr), _renderer(nullptr), _address(address), _port(port), _online(port != -1){
+Game::Game(const char* address, int port, bool ipv6) : _window(nullptr), _renderer(nullptr), _address(address), _port(port), _online(port != -1), _computerEnabled(false), _searchGeneration(0), _showBookMove(false), _showExplorer(false){
     if (SDL_Init(SDL_INIT_VIDEO) != 0){
         std::string errorMessage("SDL could not initialize: ");
         errorMessage.append(SDL_GetError());
@@ -123,6 +136,12 @@ Game::Game(const char* address, int port, bool ipv6) : _window(nullptr), _render
         errorMessage.append(TTF_GetError());
         throw std::runtime_error(errorMessage);
     }
+    _smallFont = TTF_OpenFont(_fontPath, _smallFontSize);
+    if (_smallFont == nullptr){
+        std::string errorMessage("Font could not opened: ");
+        errorMessage.append(TTF_GetError());
+        throw std::runtime_error(errorMessage);
+    }
     SDL_Rect resetButtonRect{_boardWidth + (_sidebarWidth-_buttonWidth)/2, _boardHeight + (_bottomBarHeight-_buttonHeight)/2, _buttonWidth, _buttonHeight};
     auto resetter = [this](){
         resetState();
@@ -132,15 +151,23 @@ Game::Game(const char* address, int port, bool ipv6) : _window(nullptr), _render
         }
     };
     SDL_Rect switchButtonRect{resetButtonRect.x - _buttonWidth - _buttonMargin, _boardHeight + (_bottomBarHeight-_buttonHeight)/2, _buttonWidth, _buttonHeight};
+    SDL_Rect computerButtonRect{switchButtonRect.x - _buttonWidth - _buttonMargin, _boardHeight + (_bottomBarHeight-_buttonHeight)/2, _buttonWidth, _buttonHeight};
     _buttons.emplace_back(resetButtonRect, resetter, u"重新開始", _borderColor, _boardSpaceColor, _borderWidth, u"确定?", _shadedColor);
     if (_online){
-        // cannot switch sides in online play
+        // cannot switch sides or play the computer in online play
         _buttons.emplace_back(switchButtonRect, [](){ return; }, u"換邊", _borderColor, _boardSpaceColor, _borderWidth, u"線上;停用", _shadedColor);
+        _buttons.emplace_back(computerButtonRect, [](){ return; }, u"電腦", _borderColor, _boardSpaceColor, _borderWidth, u"線上;停用", _shadedColor);
     }else{
         auto switcher = [this](){
             _playingAs = _playingAs == Side::Red? Side::Black:Side::Red;
+            cancelComputerMove();
         };
         _buttons.emplace_back(switchButtonRect, switcher, u"換邊", _borderColor, _boardSpaceColor, _borderWidth);
+        auto computerToggler = [this](){
+            _computerEnabled = !_computerEnabled;
+            cancelComputerMove();
+        };
+        _buttons.emplace_back(computerButtonRect, computerToggler, u"電腦", _borderColor, _boardSpaceColor, _borderWidth);
     }
     if (_online){
         if (_address == nullptr){
@@ -163,14 +190,22 @@ Game::Game(const char* address, int port, bool ipv6) : _window(nullptr), _render
     }else{
         _playingAs = Side::Red;
     }
+    _book.open(_bookPath); // no book moves or hints without one
+    _index.open(_indexPath); // no explorer without one
     resetState();
 }
 
 Game::~Game(){
+    _quit = true;
+    _engine.stop();
+    if (_computerPlayer.valid()){
+        _computerPlayer.get();
+    }
     SDL_DestroyWindow(_window);
     SDL_DestroyRenderer(_renderer);
     SDL_Quit();
     TTF_CloseFont(_font);
+    TTF_CloseFont(_smallFont);
     TTF_Quit();
     if (_server){
         _server->~Server();
@@ -236,6 +271,41 @@ void Game::run(){
         });
     }else{
         updateWindow();
+        // computer player in parallel thread, searches a copy of the game whenever it is the computer's turn
+        _computerPlayer = std::async(std::launch::async, [this](){
+            std::mt19937_64 random(std::random_device{}());
+            while (!_quit){
+                std::this_thread::sleep_for(std::chrono::milliseconds{5}); // prevent busy loop
+                std::optional<GameState> position;
+                int generation;
+                uint64_t stops; // a cancel after this stops the search even if it comes before the search starts
+                threadsafeCall([this, &position, &generation, &stops](){
+                    if (!_quit && _computerEnabled && !_state.gameOver() && _state.currentTurn() != _playingAs){
+                        position = _state;
+                        generation = _searchGeneration;
+                        stops = _engine.stopCount();
+                    }
+                });
+                if (!position){
+                    continue;
+                }
+                // plays from the book while the position is in it, varied by weight so games differ
+                SearchResult result{_book.pickMove(*position, random()), 0, 0, 0, 0, 0, 0};
+                if (result.bestMove.isNull()){
+                    result = _engine.search(*position, Limits{_computerThinkSeconds}, stops);
+                }
+                threadsafeCall([this, &result, generation](){
+                    if (generation != _searchGeneration || result.bestMove.isNull()){ // game changed while searching
+                        return;
+                    }
+                    Piece* pieceP = _state.findPiece(toPosition(result.bestMove.from()));
+                    updateLastMoved(pieceP);
+                    _state.performMove(pieceP, toPosition(result.bestMove.to()));
+                    redraw();
+                    updateWindow();
+                });
+            }
+        });
     }
     // main thread event handler
     SDL_Event event;
@@ -252,6 +322,21 @@ void Game::run(){
                         });
                     }
                     return;
+                case (SDL_KEYDOWN):
+                    if (event.key.keysym.sym == SDLK_b && _book.loaded()){
+                        threadsafeCall([this](){
+                            _showBookMove = !_showBookMove;
+                            redraw();
+                            updateWindow();
+                        });
+                    }else if (event.key.keysym.sym == SDLK_e && _index.loaded()){
+                        threadsafeCall([this](){
+                            _showExplorer = !_showExplorer;
+                            redraw();
+                            updateWindow();
+                        });
+                    }
+                    break;
                 case (SDL_MOUSEBUTTONDOWN):
                     if (_online && !connected()){
                         break; // ignore if still connecting
@@ -292,8 +377,8 @@ void Game::select(int mouseX, int mouseY){
     for (Position move : _moves){
         if (withinDist(mousePos, toPixel(move), _moveCircleRadius)){
             // can only move if your turn
-            if (!_state.checkmate() && _selectedPiece != nullptr && _selectedPiece->side == _state.currentTurn()){
-                if (!_online){
+            if (!_state.gameOver() && _selectedPiece != nullptr && _selectedPiece->side == _state.currentTurn()){
+                if (!_online && (!_computerEnabled || _selectedPiece->side == _playingAs)){ // computer's pieces are off limits
                     updateLastMoved(_selectedPiece);
                     _state.performMove(_selectedPiece, move);
                 }else if (_online && _selectedPiece->side == _playingAs){ // if online, can only move your own pieces
@@ -371,6 +456,16 @@ void Game::redraw(){
         // draw afterimage of last move made
         drawCircle(toPixel(_lastMovedFrom), _pieceRadius, _moveAfterimageColor);
     }
+    if (_showBookMove && !_state.gameOver()){
+        Move bookMove = _book.bestMove(_state);
+        if (!bookMove.isNull()){
+            drawBorder(toPixel(toPosition(bookMove.from())), _pieceRadius+_borderWidth+1, _borderWidth, _bookMoveColor);
+            drawBorder(toPixel(toPosition(bookMove.to())), _pieceRadius+_borderWidth+1, _borderWidth, _bookMoveColor);
+        }
+    }
+    if (_showExplorer){
+        drawExplorer();
+    }
     if (_state.check()){ // .check is true if in check or checkmate
         // draw highlight on enemy shuai
         Position oppShuaiPos = _state.pieces()[_state.checking() == Side::Red? 1:0].pos;
@@ -426,6 +521,45 @@ void Game::drawText(SDL_Renderer* renderer, TTF_Font* font, const char16_t* text
     SDL_DestroyTexture(tex);
 }
 
+void Game::drawExplorer(){
+    SDL_SetRenderDrawColor(_renderer, _sidebarColor.r, _sidebarColor.g, _sidebarColor.b, _sidebarColor.a);
+    SDL_Rect sidebarRect{_boardWidth + _borderWidth/2, 0, _sidebarWidth, _boardHeight};
+    SDL_RenderFillRect(_renderer, &sidebarRect);
+    int x = _boardWidth + _sidebarWidth/2;
+    int y = _explorerLineHeight;
+    const IndexedPosition* position = _index.find(_state);
+    if (position == nullptr){
+        drawText(_renderer, _smallFont, u"無棋譜", PixelPos{x, y}, _borderColor);
+        return;
+    }
+    // the score of each move is for the side that plays it, a draw counting half
+    int us = _state.currentTurn() == Side::Red? 0:2;
+    auto score = [us](const uint32_t* results){
+        uint32_t games = results[0] + results[1] + results[2];
+        return games == 0? 0 : static_cast<int>((100*results[us] + 50*results[1]) / games);
+    };
+    auto ascii = [](const std::string& text){
+        return std::u16string(text.begin(), text.end());
+    };
+    auto line = [this, x, &y](const std::u16string& text, SDL_Color color){
+        drawText(_renderer, _smallFont, text.c_str(), PixelPos{x, y}, color);
+        y += _explorerLineHeight;
+    };
+    auto percent = [&ascii, position](int result){
+        uint32_t games = std::max(1u, position->results[0] + position->results[1] + position->results[2]);
+        return ascii(std::to_string(100*position->results[result] / games) + "%");
+    };
+    line(ascii(std::to_string(position->postingCount)) + u" 局", _borderColor);
+    line(u"紅" + percent(0) + u" 和" + percent(1) + u" 黑" + percent(2), _borderColor);
+    const IndexedMove* moves = _index.moves(*position);
+    for (int i=0; i<std::min<int>(position->moveCount, _explorerMoves); ++i){
+        char wxf[_wxfLength];
+        writeWxf(_state, Move::fromRaw(moves[i].move), wxf);
+        line(ascii(std::string(wxf, _wxfLength) + "  " + std::to_string(moves[i].count) + "  " + std::to_string(score(moves[i].results)) + "%"),
+             _state.currentTurn() == Side::Red? _redPieceBorderColor : _blackPieceBorderColor);
+    }
+}
+
 void Game::drawPiece(Piece piece, PixelPos specifyPos){
     PixelPos pPos = specifyPos == PixelPos{-1, -1}? toPixel(piece.pos):specifyPos;
     SDL_Color borderColor = piece.side == Side::Red? _redPieceBorderColor:_blackPieceBorderColor;
@@ -503,9 +637,13 @@ void Game::refreshBoard(){
     SDL_SetRenderDrawColor(_renderer, _borderColor.r, _borderColor.g, _borderColor.b, _borderColor.a);
     SDL_Rect bottomBorderRect{0, _boardHeight, _boardWidth+_sidebarWidth, _borderWidth};
     SDL_RenderFillRect(_renderer, &bottomBorderRect);
-    if (_state.checkmate() && _state.checking() == Side::Red){
+    // the side to move wins only when the other side broke the repetition rules
+    Side winner = _state.ruling() == Ruling::Win? _state.currentTurn() : _state.checking();
+    if (_state.ruling() == Ruling::Draw){
+        drawText(u"和棋", PixelPos{_textPos, _boardHeight+_bottomBarHeight/2}, _borderColor);
+    }else if (_state.gameOver() && winner == Side::Red){
         drawText(u"紅方贏", PixelPos{_textPos, _boardHeight+_bottomBarHeight/2}, _redPieceBorderColor);
-    }else if (_state.checkmate() && _state.checking() == Side::Black){
+    }else if (_state.gameOver() && winner == Side::Black){
         drawText(u"黑方贏", PixelPos{_textPos, _boardHeight+_bottomBarHeight/2}, _blackPieceBorderColor);
     }else if (_state.currentTurn() == Side::Red){
         drawText(u"紅方走", PixelPos{_textPos, _boardHeight+_bottomBarHeight/2}, _redPieceBorderColor);
@@ -581,8 +719,15 @@ void Game::updateLastMoved(Piece* movedPiece){
 }
 
 void Game::resetState(){
+    cancelComputerMove();
     _state.reset();
     _selectedPiece = nullptr;
     _moves.clear();
     _lastMovedPiece = nullptr;
 }
+
+/* COMPUTER */
+void Game::cancelComputerMove(){
+    ++_searchGeneration;
+    _engine.stop();
+}
@@ -16,6 +16,7 @@
 #include <future>
 #include <atomic>
 #include <mutex>
+#include <random>
 #include <stdexcept>
 #include <cassert>
 #include <cstdlib>
@@ -25,6 +26,10 @@
 #include <SDL2/SDL_ttf.h>
 
 #include "game_logic.hpp"
+#include "engine.hpp"
+#include "opening_book.hpp"
+#include "position_index.hpp"
+#include "notation.hpp"
 #include "socket.hpp"
 
 class Game{
@@ -33,6 +38,7 @@ class Game{
     SDL_Renderer* _renderer;
     // SDL_Texture* _boardImg;
     TTF_Font* _font;
+    TTF_Font* _smallFont; // for the explorer
     
     struct PixelPos{
         int x, y;
@@ -118,6 +124,21 @@ class Game{
     Piece* _lastMovedPiece; // in state._pieces
     Position _lastMovedFrom;
     
+    /* COMPUTER */
+    // offline only, the computer plays whichever side _playingAs is not
+    bool _computerEnabled;
+    Engine _engine;
+    int _searchGeneration; // bumped to throw away the result of a search that is already running
+    std::future<void> _computerPlayer;
+    
+    /* OPENING BOOK */
+    OpeningBook _book; // empty if there is no book file
+    bool _showBookMove; // toggled with the B key, marks the book's best move for the side to move
+    
+    /* EXPLORER */
+    PositionIndex _index; // empty if there is no index file
+    bool _showExplorer; // toggled with the E key, covers the sidebar with the results and moves of indexed games from this position
+    
     std::mutex _mutex;
     
 public:
@@ -151,6 +172,8 @@ private:
     
     void drawPiece(Piece piece, PixelPos specifyPos = {-1, -1});
     
+    void drawExplorer();
+    
     // clears pieces leaving only board and other guis
     void refreshBoard();
     
@@ -176,4 +199,8 @@ private:
     void updateLastMoved(Piece* movedPiece);
     
     void resetState();
+    
+    /* COMPUTER */
+    // stops any search in progress and discards its move
+    void cancelComputerMove();
 };
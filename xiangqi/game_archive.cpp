@@ -0,0 +1,448 @@
+//
+//  game_archive.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "game_archive.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "notation.hpp"
+
+ArchiveWriter::ArchiveWriter(const char* path) : _file(fopen(path, "wb")), _gameCount(0), _offset(sizeof(ArchiveHeader)){
+    if (_file == nullptr){
+        throw std::runtime_error(std::string("ArchiveWriter: Could not create ") + path + ": " + strerror(errno));
+    }
+    ArchiveHeader header{};
+    fwrite(&header, sizeof(header), 1, _file); // filled in by close
+    _block.reserve(_archiveBlockBytes + sizeof(ArchiveGameHeader) + 256 + 2*UINT16_MAX);
+}
+
+ArchiveWriter::~ArchiveWriter(){
+    try{
+        close();
+    }catch (const std::exception& error){
+        std::cerr << error.what() << '\n';
+    }
+}
+
+void ArchiveWriter::flushBlock(){
+    if (_block.empty()){
+        return;
+    }
+    if (fwrite(_block.data(), 1, _block.size(), _file) != _block.size()){
+        throw std::runtime_error(std::string("ArchiveWriter: Could not write: ") + strerror(errno));
+    }
+    _offset += _block.size();
+    _block.clear();
+}
+
+void ArchiveWriter::write(ArchiveResult result, std::string_view fen, const Move* moves, int plies){
+    if (fen.size() > UINT8_MAX || plies > UINT16_MAX){
+        throw std::runtime_error("ArchiveWriter: game too long to store");
+    }
+    if (_block.empty()){
+        _index.push_back(ArchiveBlock{_offset, _gameCount});
+    }
+    ArchiveGameHeader header{static_cast<uint8_t>(result), static_cast<uint8_t>(fen.size()), static_cast<uint16_t>(plies)};
+    size_t start = _block.size();
+    _block.resize(start + sizeof(header) + (fen.size()+1)/2*2 + plies*sizeof(uint16_t)); // padding is zeroed by resize
+    uint8_t* p = _block.data() + start;
+    memcpy(p, &header, sizeof(header));
+    memcpy(p + sizeof(header), fen.data(), fen.size());
+    p += sizeof(header) + (fen.size()+1)/2*2;
+    for (int ply=0; ply<plies; ++ply){
+        uint16_t raw = moves[ply].raw();
+        memcpy(p + ply*sizeof(raw), &raw, sizeof(raw));
+    }
+    ++_gameCount;
+    if (_block.size() >= _archiveBlockBytes){
+        flushBlock();
+    }
+}
+
+void ArchiveWriter::close(){
+    if (_file == nullptr){
+        return;
+    }
+    flushBlock();
+    ArchiveHeader header{{'X', 'Q', 'G', 'A'}, _archiveVersion, _gameCount, _offset, static_cast<uint32_t>(_index.size()), 0};
+    _index.push_back(ArchiveBlock{_offset, _gameCount});
+    bool written = fwrite(_index.data(), sizeof(ArchiveBlock), _index.size(), _file) == _index.size() &&
+        fseek(_file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, _file) == 1;
+    written = fclose(_file) == 0 && written;
+    _file = nullptr;
+    if (!written){
+        throw std::runtime_error(std::string("ArchiveWriter: Could not finish the archive: ") + strerror(errno));
+    }
+}
+
+uint64_t ArchiveWriter::gameCount() const{
+    return _gameCount;
+}
+
+GameArchive::GameArchive() : _data(nullptr), _size(0), _header{}, _index(nullptr){}
+
+GameArchive::~GameArchive(){
+    close();
+}
+
+void GameArchive::close(){
+    if (_data != nullptr){
+        munmap(const_cast<uint8_t*>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+    _header = ArchiveHeader{};
+    _index = nullptr;
+}
+
+void GameArchive::open(const char* path){
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1){
+        throw std::runtime_error(std::string("GameArchive::open: Could not open ") + path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < sizeof(ArchiveHeader)){
+        ::close(fd);
+        throw std::runtime_error(std::string("GameArchive::open: ") + path + " is too short to be an archive");
+    }
+    void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid
+    if (memory == MAP_FAILED){
+        throw std::runtime_error(std::string("GameArchive::open: Could not map ") + path + ": " + strerror(errno));
+    }
+    madvise(memory, info.st_size, MADV_SEQUENTIAL); // games are read front to back, each thread through its own blocks
+    _data = static_cast<const uint8_t*>(memory);
+    _size = info.st_size;
+    memcpy(&_header, _data, sizeof(_header));
+    if (memcmp(_header.magic, "XQGA", 4) != 0 || _header.version != _archiveVersion ||
+        _header.indexOffset + (_header.blockCount + 1ull)*sizeof(ArchiveBlock) != _size){
+        close();
+        throw std::runtime_error(std::string("GameArchive::open: ") + path + " is not a version " + std::to_string(_archiveVersion) + " archive");
+    }
+    _index = _data + _header.indexOffset;
+    for (uint32_t i=0; i<=_header.blockCount; ++i){
+        ArchiveBlock entry = block(i);
+        if (entry.offset < sizeof(ArchiveHeader) || entry.offset > _header.indexOffset || (i > 0 && entry.offset < block(i-1).offset)){
+            close();
+            throw std::runtime_error(std::string("GameArchive::open: ") + path + " has a broken block index");
+        }
+    }
+}
+
+uint64_t GameArchive::gameCount() const{
+    return _header.gameCount;
+}
+
+uint32_t GameArchive::blockCount() const{
+    return _header.blockCount;
+}
+
+ArchiveBlock GameArchive::block(uint32_t index) const{
+    ArchiveBlock entry;
+    memcpy(&entry, _index + index*sizeof(ArchiveBlock), sizeof(entry));
+    return entry;
+}
+
+GameArchive::Cursor::Cursor(const uint8_t* begin, const uint8_t* end) : _position(begin), _end(end){}
+
+bool GameArchive::Cursor::next(ArchiveGame& game){
+    if (_position == _end){
+        return false;
+    }
+    ArchiveGameHeader header;
+    if (static_cast<size_t>(_end - _position) < sizeof(header)){
+        throw std::runtime_error("GameArchive: game cut off at the end of a block");
+    }
+    memcpy(&header, _position, sizeof(header));
+    size_t size = sizeof(header) + (header.fenLength+1)/2*2 + header.plies*sizeof(uint16_t);
+    if (static_cast<size_t>(_end - _position) < size){
+        throw std::runtime_error("GameArchive: game cut off at the end of a block");
+    }
+    game.result = static_cast<ArchiveResult>(header.result);
+    game.fen = std::string_view(reinterpret_cast<const char*>(_position + sizeof(header)), header.fenLength);
+    game.plies = header.plies;
+    game.moves = _position + sizeof(header) + (header.fenLength+1)/2*2;
+    _position += size;
+    return true;
+}
+
+GameArchive::Cursor GameArchive::games(uint32_t first, uint32_t last) const{
+    return Cursor(_data + block(first).offset, _data + block(last).offset);
+}
+
+// reads games out of PGN or one-game-per-line text, handing each finished game to the writer
+class TextGameReader{
+    ArchiveWriter& _writer;
+    GameState _state;
+    std::string _fen;
+    std::vector<Move> _moves;
+    ArchiveResult _result;
+    bool _tagged; // PGN, ends at a result or the next game's tags rather than at the end of the line
+    bool _broken; // a move could not be read or was not legal, the rest of the game is skipped
+    bool _inComment;
+    int _variationDepth;
+
+    void begin(){
+        _state.reset();
+        _fen.clear();
+        _moves.clear();
+        _result = ArchiveResult::Unknown;
+        _tagged = false;
+        _broken = false;
+        _variationDepth = 0;
+    }
+
+    void finish(){
+        if (_broken){
+            ++skipped;
+        }else if (!_moves.empty()){
+            if (_fen.size() > UINT8_MAX || _moves.size() > UINT16_MAX){
+                ++skipped;
+            }else{
+                _writer.write(_result, _fen, _moves.data(), static_cast<int>(_moves.size()));
+            }
+        }
+        begin();
+    }
+
+    static bool parseResult(std::string_view token, ArchiveResult& result){
+        if (token == "1-0"){
+            result = ArchiveResult::RedWon;
+        }else if (token == "0-1"){
+            result = ArchiveResult::BlackWon;
+        }else if (token == "1/2-1/2"){
+            result = ArchiveResult::Draw;
+        }else if (token == "*"){
+            result = ArchiveResult::Unknown;
+        }else{
+            return false;
+        }
+        return true;
+    }
+
+    // [Name "value"]
+    void readTag(std::string_view line){
+        if (!_moves.empty() || _broken){ // the last game had no result token
+            finish();
+        }
+        _tagged = true;
+        size_t nameEnd = line.find_first_of(" \t", 1);
+        size_t valueStart = line.find('"');
+        size_t valueEnd = line.rfind('"');
+        if (nameEnd == std::string_view::npos || valueStart == std::string_view::npos || valueEnd <= valueStart){
+            return;
+        }
+        std::string_view name = line.substr(1, nameEnd-1);
+        std::string_view value = line.substr(valueStart+1, valueEnd-valueStart-1);
+        if (name == "FEN"){
+            _fen = value;
+            _broken = !_state.loadFen(value);
+        }else if (name == "Result"){
+            parseResult(value, _result);
+        }
+    }
+
+    void readToken(std::string_view token){
+        ArchiveResult result;
+        if (parseResult(token, result)){
+            if (result != ArchiveResult::Unknown){
+                _result = result;
+            }
+            finish();
+            return;
+        }
+        size_t digits = 0;
+        for (; digits < token.size() && token[digits] >= '0' && token[digits] <= '9'; ++digits);
+        if (digits > 0){ // move number, "1." or "1..." possibly with the move stuck to it
+            size_t dots = digits;
+            for (; dots < token.size() && token[dots] == '.'; ++dots);
+            if (dots == digits){
+                _broken = true;
+                return;
+            }
+            token.remove_prefix(dots);
+        }
+        while (!token.empty() && (token.back() == '!' || token.back() == '?')){
+            token.remove_suffix(1);
+        }
+        if (token.empty() || token[0] == '$' || _broken){ // annotation glyph
+            return;
+        }
+        char iccs[_iccsLength];
+        Move move;
+        bool read;
+        if (token.size() == _iccsLength+1 && token[2] == '-'){ // "H2-E2"
+            for (int i=0; i<_iccsLength; ++i){
+                iccs[i] = static_cast<char>(token[i < 2? i : i+1] | 0x20);
+            }
+            read = parseIccs(std::string_view(iccs, _iccsLength), move);
+        }else if (token.size() == _iccsLength && parseIccs(token, move)){
+            read = true;
+        }else{
+            read = parseWxf(token, _state, move);
+        }
+        if (!read || !_state.isLegal(move)){
+            _broken = true;
+            return;
+        }
+        _moves.push_back(move);
+        _state.performMove(move);
+    }
+
+public:
+    uint64_t skipped;
+
+    explicit TextGameReader(ArchiveWriter& writer) : _writer(writer), _inComment(false), skipped(0){
+        begin();
+    }
+
+    void readLine(std::string_view line){
+        if (!line.empty() && line.back() == '\r'){
+            line.remove_suffix(1);
+        }
+        size_t first = line.find_first_not_of(" \t");
+        if (!_inComment && first != std::string_view::npos && line[first] == '['){
+            readTag(line.substr(first));
+            return;
+        }
+        for (size_t i=0; i<line.size();){
+            char c = line[i];
+            if (_inComment){
+                _inComment = c != '}';
+                ++i;
+            }else if (c == '{'){
+                _inComment = true;
+                ++i;
+            }else if (c == ';'){ // comment to the end of the line
+                break;
+            }else if (c == '(' || c == ')'){ // variations are skipped
+                _variationDepth = std::max(0, _variationDepth + (c == '('? 1 : -1));
+                ++i;
+            }else if (c == ' ' || c == '\t'){
+                ++i;
+            }else{
+                size_t end = std::min(line.find_first_of(" \t{}();", i), line.size());
+                if (_variationDepth == 0){
+                    readToken(line.substr(i, end-i));
+                }
+                i = end;
+            }
+        }
+        if (!_tagged && !_inComment && (!_moves.empty() || _broken)){ // one game per line
+            finish();
+        }
+    }
+
+    void end(){
+        if (!_moves.empty() || _broken){
+            finish();
+        }
+    }
+};
+
+static int convertGames(const char* textPath, const char* archivePath){
+    std::ifstream text(textPath);
+    if (!text){
+        throw std::runtime_error(std::string("archive: Could not open ") + textPath);
+    }
+    auto start = std::chrono::steady_clock::now();
+    ArchiveWriter writer(archivePath);
+    TextGameReader reader(writer);
+    for (std::string line; std::getline(text, line);){
+        reader.readLine(line);
+    }
+    reader.end();
+    writer.close();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(1) << writer.gameCount() << " games written, " << reader.skipped << " skipped, "
+              << writer.gameCount() / std::max(seconds, 1e-9) << " games/s\n";
+    return 0;
+}
+
+static int replayArchive(const char* path, int threads, bool verify){
+    GameArchive archive;
+    archive.open(path);
+    if (threads <= 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::atomic<uint32_t> nextBlock(0);
+    std::atomic<uint64_t> games(0), plies(0), failed(0), checksum(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> workers;
+    for (int thread=0; thread<threads; ++thread){
+        workers.push_back(std::async(std::launch::async, [&](){
+            GameState state;
+            uint64_t localGames = 0, localPlies = 0, localFailed = 0, localChecksum = 0;
+            // blocks are a few hundred games each, small enough that taking them one at a time balances the threads
+            for (uint32_t block = nextBlock++; block < archive.blockCount(); block = nextBlock++){
+                GameArchive::Cursor cursor = archive.games(block, block+1);
+                for (ArchiveGame game; cursor.next(game);){
+                    ++localGames;
+                    localPlies += game.plies;
+                    if (!replayGame(game, state, verify, [](const GameState&, Move){})){
+                        ++localFailed;
+                    }
+                    localChecksum += state.hash(); // the same whatever order the blocks are replayed in
+                }
+            }
+            games += localGames;
+            plies += localPlies;
+            failed += localFailed;
+            checksum += localChecksum;
+        }));
+    }
+    for (std::future<void>& worker : workers){
+        worker.get();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(1) << games << " games, " << plies << " plies, " << failed << " failed in "
+              << std::setprecision(3) << seconds << "s with " << threads << " threads\n" << std::setprecision(1)
+              << games / std::max(seconds, 1e-9) << " games/s, " << plies / std::max(seconds, 1e-9) << " plies/s, checksum "
+              << std::hex << checksum << std::dec << '\n';
+    return failed == 0? 0:1;
+}
+
+int runArchive(int argc, const char* argv[]){
+    if (argc >= 3 && strcmp(argv[0], "convert") == 0){
+        if (argc > 3){
+            throw std::runtime_error(std::string("archive: unknown argument ") + argv[3]);
+        }
+        return convertGames(argv[1], argv[2]);
+    }
+    if (argc >= 2 && strcmp(argv[0], "replay") == 0){
+        int threads = 0;
+        bool verify = false;
+        for (int i=2; i<argc; ++i){
+            if (strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+                threads = std::atoi(argv[++i]);
+            }else if (strcmp(argv[i], "--verify") == 0){
+                verify = true;
+            }else{
+                throw std::runtime_error(std::string("archive: unknown argument ") + argv[i]);
+            }
+        }
+        return replayArchive(argv[1], threads, verify);
+    }
+    throw std::runtime_error("archive: expected convert <games> <archive> or replay <archive>");
+}
@@ -0,0 +1,179 @@
+//
+//  game_archive.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "game_logic.hpp"
+#include "move.hpp"
+
+// ./main archive convert <games> <archive>
+// games is text, PGN with ICCS ("h2e2" or "H2-E2") or WXF moves and optional FEN and Result tags, or one game per line as for ./main book
+// read a line at a time, so the input can be bigger than memory, games with a move that is not legal are left out
+// ./main archive replay <archive> [--threads <n>, 0 for all cores] [--verify]
+// plays every game through GameState, split by block across threads, and reports games/s, --verify checks each move is legal
+int runArchive(int argc, const char* argv[]);
+
+/*
+ game archive, little endian
+ - ArchiveHeader
+ - blocks of whole games, a new block starts once one passes _archiveBlockBytes
+ - per game: ArchiveGameHeader, then the start FEN if any padded to an even length, then uint16_t moves[plies] as Move::raw
+ - ArchiveBlock index[blockCount+1] at indexOffset, the last entry only marks where the blocks end
+ */
+struct ArchiveHeader{
+    char magic[4]; // "XQGA"
+    uint32_t version; // _archiveVersion
+    uint64_t gameCount;
+    uint64_t indexOffset;
+    uint32_t blockCount;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ArchiveHeader) == 32);
+
+struct ArchiveGameHeader{
+    uint8_t result; // ArchiveResult
+    uint8_t fenLength; // 0 for the standard start
+    uint16_t plies;
+};
+
+static_assert(sizeof(ArchiveGameHeader) == 4);
+
+struct ArchiveBlock{
+    uint64_t offset; // from the start of the file
+    uint64_t firstGame;
+};
+
+constexpr static uint32_t _archiveVersion = 1;
+constexpr static size_t _archiveBlockBytes = 1 << 16;
+
+enum class ArchiveResult : uint8_t{
+    RedWon,
+    Draw,
+    BlackWon,
+    Unknown,
+};
+
+// one game, pointing into the mapped file
+struct ArchiveGame{
+    ArchiveResult result;
+    std::string_view fen;
+    int plies;
+    const uint8_t* moves; // only 2 byte aligned
+
+    Move move(int ply) const{
+        uint16_t raw;
+        memcpy(&raw, moves + ply*sizeof(raw), sizeof(raw));
+        return Move::fromRaw(raw);
+    }
+};
+
+// writes games as they come, the index and game count go in when the archive is closed
+class ArchiveWriter{
+    FILE* _file;
+    std::vector<uint8_t> _block;
+    std::vector<ArchiveBlock> _index;
+    uint64_t _gameCount;
+    uint64_t _offset; // where _block goes in the file
+
+    void flushBlock();
+
+public:
+    ArchiveWriter(const ArchiveWriter&) = delete;
+
+    // throws if the file cannot be created
+    explicit ArchiveWriter(const char* path);
+
+    ~ArchiveWriter();
+
+    // fen empty for the standard start, at most 255 characters and 65535 moves
+    void write(ArchiveResult result, std::string_view fen, const Move* moves, int plies);
+
+    // writes the index and header, called by the destructor if not before
+    void close();
+
+    uint64_t gameCount() const;
+};
+
+class GameArchive{
+    const uint8_t* _data; // mapped read only, nullptr if no archive is open
+    size_t _size;
+    ArchiveHeader _header;
+    const uint8_t* _index;
+
+    void close();
+
+public:
+    GameArchive(const GameArchive&) = delete;
+
+    GameArchive();
+
+    ~GameArchive();
+
+    // maps the file, throws if it cannot be read or is not an archive
+    void open(const char* path);
+
+    uint64_t gameCount() const;
+
+    uint32_t blockCount() const;
+
+    ArchiveBlock block(uint32_t index) const;
+
+    // reads the games of blocks [first, last) in order, so threads can each take their own range
+    class Cursor{
+        const uint8_t* _position;
+        const uint8_t* _end;
+
+    public:
+        Cursor(const uint8_t* begin, const uint8_t* end);
+
+        // false at the end of the range, throws if a game runs past it
+        bool next(ArchiveGame& game);
+    };
+
+    Cursor games(uint32_t first, uint32_t last) const;
+};
+
+// sets up the start of game and plays every move through state, visit(state, move) is called before each
+// false if the FEN is invalid or at the first illegal move with verify, without it only moves that would break state are caught:
+// squares off the board, no piece of the side to move to move, or taking one of its own pieces or a shuai
+template<typename Visit>
+bool replayGame(const ArchiveGame& game, GameState& state, bool verify, Visit&& visit){
+    if (game.fen.empty()){
+        state.reset();
+    }else if (!state.loadFen(game.fen)){
+        return false;
+    }
+    for (int ply=0; ply<game.plies; ++ply){
+        Move move = game.move(ply);
+        if (verify){
+            if (!state.isLegal(move)){
+                return false;
+            }
+        }else{
+            if (move.from() >= _squareCount || move.to() >= _squareCount){
+                return false;
+            }
+            const Piece* piece = state.pieceAt(move.from());
+            const Piece* target = state.pieceAt(move.to());
+            if (piece == nullptr || piece->side != state.currentTurn() ||
+                (target != nullptr && (target->side == piece->side || target->type == PieceType::Shuai))){
+                return false;
+            }
+        }
+        visit(static_cast<const GameState&>(state), move);
+        state.performMove(move);
+    }
+    return true;
+}
@@ -7,6 +7,10 @@
 
 #include "game_logic.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <cassert>
+
 bool Position::operator==(Position other) const{
     return x == other.x && y == other.y;
 }
@@ -15,19 +19,135 @@ bool Piece::operator==(Piece other) const{
     return pos == other.pos && type == other.type && side == other.side && captured == other.captured;
 }
 
-GameState::TempPiecesState::TempPiecesState(GameState* stateP, Piece* pieceP, Position move) : _gameState(stateP){
-    _prevPiecesState = _gameState->_pieces;
-    _prevPieceGridState = _gameState->_pieceGrid;
-    _gameState->performMove(pieceP, move, true);
+void GameState::switchTurns(){
+    _currentTurn = otherSide(_currentTurn);
+    _hash ^= _zobrist.blackToMove;
 }
 
-GameState::TempPiecesState::~TempPiecesState(){
-    _gameState->_pieces = _prevPiecesState;
-    _gameState->_pieceGrid = _prevPieceGridState;
+void GameState::placePiece(int index, int square){
+    Piece& piece = _pieces[index];
+    Bitboard bit = squareBit(square);
+    _mailbox[square] = index;
+    _sideOccupancy[static_cast<int>(piece.side)] |= bit;
+    _typeOccupancy[static_cast<int>(piece.type)] |= bit;
+    _fileOccupancy |= rotatedBit(square);
+    _hash ^= _zobrist.pieces[static_cast<int>(piece.side)][static_cast<int>(piece.type)][square];
+    _midgame += _pieceSquare.midgame[static_cast<int>(piece.side)][static_cast<int>(piece.type)][square];
+    _endgame += _pieceSquare.endgame[static_cast<int>(piece.side)][static_cast<int>(piece.type)][square];
+    _phase += _phaseWeights[static_cast<int>(piece.type)];
+    piece.pos = toPosition(square);
+    if (_network != nullptr){
+        updateAccumulators(index, square, true);
+    }
 }
 
-void GameState::switchTurns(){
-    _currentTurn = _currentTurn == Side::Red? Side::Black:Side::Red;
+void GameState::removePiece(int index){
+    Piece& piece = _pieces[index];
+    int square = toSquare(piece.pos);
+    Bitboard bit = squareBit(square);
+    _mailbox[square] = _noPiece;
+    _sideOccupancy[static_cast<int>(piece.side)] &= ~bit;
+    _typeOccupancy[static_cast<int>(piece.type)] &= ~bit;
+    _fileOccupancy &= ~rotatedBit(square);
+    _hash ^= _zobrist.pieces[static_cast<int>(piece.side)][static_cast<int>(piece.type)][square];
+    _midgame -= _pieceSquare.midgame[static_cast<int>(piece.side)][static_cast<int>(piece.type)][square];
+    _endgame -= _pieceSquare.endgame[static_cast<int>(piece.side)][static_cast<int>(piece.type)][square];
+    _phase -= _phaseWeights[static_cast<int>(piece.type)];
+    if (_network != nullptr){
+        updateAccumulators(index, square, false);
+    }
+}
+
+void GameState::updateAccumulators(int index, int square, bool add){
+    const Piece& piece = _pieces[index];
+    for (int perspective=0; perspective<2; ++perspective){
+        if (piece.type == PieceType::Shuai && static_cast<int>(piece.side) == perspective){
+            if (add){ // every feature of this side depends on where its shuai is
+                refreshAccumulator(perspective);
+            }
+            continue;
+        }
+        if (_pieces[perspective].captured){ // rebuilt when the shuai comes back
+            continue;
+        }
+        int feature = nnueFeature(perspective, toSquare(_pieces[perspective].pos), static_cast<int>(piece.side), static_cast<int>(piece.type), square);
+        if (add){
+            addFeature(_accumulator[perspective], feature);
+        }else{
+            subtractFeature(_accumulator[perspective], feature);
+        }
+    }
+}
+
+void GameState::refreshAccumulator(int perspective){
+    resetAccumulator(_accumulator[perspective]);
+    int shuai = toSquare(_pieces[perspective].pos);
+    Bitboard pieces = occupancy() & ~squareBit(shuai);
+    while (pieces){
+        int square = popLsb(pieces);
+        const Piece& piece = _pieces[_mailbox[square]];
+        addFeature(_accumulator[perspective], nnueFeature(perspective, shuai, static_cast<int>(piece.side), static_cast<int>(piece.type), square));
+    }
+}
+
+uint8_t GameState::movePiece(int index, int square){
+    uint8_t captured = _mailbox[square];
+    if (captured != _noPiece){
+        _pieces[captured].captured = true;
+        removePiece(captured);
+    }
+    removePiece(index);
+    placePiece(index, square);
+    return captured;
+}
+
+Bitboard GameState::chaseTargets(int square) const{
+    const Piece& piece = _pieces[_mailbox[square]];
+    if (piece.type == PieceType::Shuai || piece.type == PieceType::Bing){
+        return _emptyBitboard;
+    }
+    Side enemy = otherSide(piece.side);
+    Bitboard targets = pieceTargets(square) & occupancy(enemy) & ~occupancy(enemy, PieceType::Shuai);
+    Bitboard bing = targets & occupancy(enemy, PieceType::Bing);
+    while (bing != 0){ // only once across the river
+        int target = popLsb(bing);
+        if (ownSide(static_cast<int>(enemy), rankOf(target))){
+            targets &= ~squareBit(target);
+        }
+    }
+    return targets;
+}
+
+uint32_t GameState::chasedPieces(int square, Bitboard before) const{
+    Bitboard targets = chaseTargets(square) & ~before;
+    if (targets == 0){
+        return 0;
+    }
+    const Piece& piece = _pieces[_mailbox[square]];
+    Side enemy = otherSide(piece.side);
+    // protected if the enemy could take back after the capture
+    Bitboard occupied = occupancy() & ~squareBit(square);
+    Bitboard fileOccupied = _fileOccupancy & ~rotatedBit(square);
+    uint32_t chased = 0;
+    while (targets != 0){
+        int target = popLsb(targets);
+        bool valuable = _pieces[_mailbox[target]].type == PieceType::Ju && (piece.type == PieceType::Ma || piece.type == PieceType::Pao);
+        if ((valuable || attackersTo(target, enemy, occupied, fileOccupied) == 0) && legal(Move(square, target))){
+            chased |= uint32_t{1} << _mailbox[target];
+        }
+    }
+    return chased;
+}
+
+void GameState::recordMove(int square, Bitboard before, uint8_t captured){
+    const HistoryEntry& previous = _history[_plies & (_historySize-1)];
+    uint8_t quietPlies = previous.quietPlies, repetitionPlies = previous.repetitionPlies;
+    HistoryEntry& entry = _history[++_plies & (_historySize-1)];
+    entry.hash = _hash;
+    entry.quietPlies = captured != _noPiece? 0 : std::min<int>(quietPlies + 1, _historySize-1);
+    entry.repetitionPlies = captured != _noPiece? 0 : std::min<int>(repetitionPlies + 1, _historySize-1);
+    entry.check = inCheck(_currentTurn);
+    entry.chased = chasedPieces(square, before);
 }
 
 GameState::GameState(){
@@ -35,275 +155,643 @@ GameState::GameState(){
 }
 
 Piece* GameState::findPiece(Position pos){
-    if (pos.x < 0 || pos.x > 8 || pos.y < 0 || pos.y > 9){ // out of bounds
+    if (!onBoard(pos.x, pos.y)){ // out of bounds
         return nullptr;
     }
-    return _pieceGrid[pos.x][pos.y];
+    return pieceAt(toSquare(pos));
 }
 
-bool GameState::lineOfSight(Piece* pieceP, Position move){
-    TempPiecesState temp(this, pieceP, move);
-    if (_pieces[0].pos.x != _pieces[1].pos.x){
+Piece* GameState::pieceAt(int square){
+    uint8_t index = _mailbox[square];
+    return index == _noPiece? nullptr : &_pieces[index];
+}
+
+const Piece* GameState::pieceAt(int square) const{
+    uint8_t index = _mailbox[square];
+    return index == _noPiece? nullptr : &_pieces[index];
+}
+
+Bitboard GameState::occupancy() const{
+    return _sideOccupancy[0] | _sideOccupancy[1];
+}
+
+Bitboard GameState::occupancy(Side side) const{
+    return _sideOccupancy[static_cast<int>(side)];
+}
+
+Bitboard GameState::occupancy(Side side, PieceType type) const{
+    return _sideOccupancy[static_cast<int>(side)] & _typeOccupancy[static_cast<int>(type)];
+}
+
+int GameState::shuaiSquare(Side side) const{
+    return toSquare(_pieces[side == Side::Red? 0:1].pos);
+}
+
+Bitboard GameState::fileOccupancy() const{
+    return _fileOccupancy;
+}
+
+Bitboard GameState::juAttacks(int square) const{
+    return juAttacks(square, occupancy(), _fileOccupancy);
+}
+
+Bitboard GameState::paoAttacks(int square) const{
+    return paoAttacks(square, occupancy(), _fileOccupancy);
+}
+
+Bitboard GameState::juAttacks(int square, Bitboard occupied, Bitboard fileOccupied){
+    int x = fileOf(square), y = rankOf(square);
+    unsigned rankOccupied = static_cast<unsigned>(occupied >> (y*_boardFiles)) & ((1u << _boardFiles) - 1);
+    unsigned fileBits = static_cast<unsigned>(fileOccupied >> (x*_boardRanks)) & ((1u << _boardRanks) - 1);
+    return (Bitboard{_sliderTables.rank[SliderTables::_ju][x][rankOccupied]} << (y*_boardFiles)) |
+           (_sliderTables.fileSpread[_sliderTables.file[SliderTables::_ju][y][fileBits]] << x);
+}
+
+Bitboard GameState::paoAttacks(int square, Bitboard occupied, Bitboard fileOccupied){
+    int x = fileOf(square), y = rankOf(square);
+    unsigned rankOccupied = static_cast<unsigned>(occupied >> (y*_boardFiles)) & ((1u << _boardFiles) - 1);
+    unsigned fileBits = static_cast<unsigned>(fileOccupied >> (x*_boardRanks)) & ((1u << _boardRanks) - 1);
+    return (Bitboard{_sliderTables.rank[SliderTables::_pao][x][rankOccupied]} << (y*_boardFiles)) |
+           (_sliderTables.fileSpread[_sliderTables.file[SliderTables::_pao][y][fileBits]] << x);
+}
+
+bool GameState::shuaiFacing() const{
+    if (_pieces[0].captured || _pieces[1].captured){
         return false;
     }
-    // check for pieces between
-    for (int i=_pieces[1].pos.y; i<=_pieces[0].pos.y; ++i){
-        if (_pieceGrid[_pieces[0].pos.x][i] == nullptr || _pieceGrid[_pieces[0].pos.x][i]->type == PieceType::Shuai){ // ignore if not a piece that can block line of sight
-            continue;
+    int redSquare = shuaiSquare(Side::Red), blackSquare = shuaiSquare(Side::Black);
+    return fileOf(redSquare) == fileOf(blackSquare) && testBit(juAttacks(redSquare), blackSquare);
+}
+
+bool GameState::isSquareAttacked(int square, Side bySide) const{
+    // work backwards from the target: look for each piece type on the squares it could attack from
+    Bitboard occupied = occupancy();
+    // ju and pao attacks are symmetric, so look along the lines from the target
+    if ((juAttacks(square) & occupancy(bySide, PieceType::Ju)) != 0 || (paoAttacks(square) & occupancy(bySide, PieceType::Pao)) != 0){
+        return true;
+    }
+    // every other piece comes from its attacker table, with the same blocking square test as move generation
+    auto attackedFrom = [occupied](const StepMoves& steps, Bitboard attackers){
+        if ((steps.targets & attackers) == 0){
+            return false;
+        }
+        for (int i=0; i<steps.count; ++i){
+            if (testBit(attackers, steps.to[i]) && (steps.block[i] == _noBlock || !testBit(occupied, steps.block[i]))){
+                return true;
+            }
         }
         return false;
-    }
-    return true;
+    };
+    int side = static_cast<int>(bySide);
+    return attackedFrom(_maAttackers[square], occupancy(bySide, PieceType::Ma)) ||
+           attackedFrom(_bingAttackers[side][square], occupancy(bySide, PieceType::Bing)) ||
+           attackedFrom(_shuaiMoves[side][square], occupancy(bySide, PieceType::Shuai)) ||
+           attackedFrom(_shiMoves[side][square], occupancy(bySide, PieceType::Shi)) ||
+           attackedFrom(_xiangMoves[side][square], occupancy(bySide, PieceType::Xiang));
 }
 
-bool GameState::selfDanger(Piece* pieceP, Position move){
-    TempPiecesState temp(this, pieceP, move);
-    Position ownShuaiPos = _pieces[pieceP->side == Side::Red? 0:1].pos;
-    // check for pieces that will be able to capture shuai
-    for (Piece& piece : _pieces){
-        if (piece.captured || piece.side == pieceP->side){ // ignore pieces that cannot capture
-            continue;
-        }
-        std::vector<Position> moves = getMoves(&piece, false);
-        if (std::find(moves.begin(), moves.end(), ownShuaiPos) != moves.end()){ // own shuai becomes a target
-            return true;
+Bitboard GameState::attackersTo(int square, Side bySide, Bitboard occupied, Bitboard fileOccupied) const{
+    // same backwards lookup as isSquareAttacked, but collecting every attacker still in occupied
+    auto attackedFrom = [occupied](const StepMoves& steps, Bitboard attackers){
+        Bitboard found = _emptyBitboard;
+        attackers &= steps.targets;
+        for (int i=0; attackers != 0 && i<steps.count; ++i){
+            if (testBit(attackers, steps.to[i]) && (steps.block[i] == _noBlock || !testBit(occupied, steps.block[i]))){
+                found |= squareBit(steps.to[i]);
+            }
         }
-    }
-    return false;
+        return found;
+    };
+    int side = static_cast<int>(bySide);
+    Bitboard pieces = occupancy(bySide) & occupied;
+    return (juAttacks(square, occupied, fileOccupied) & pieces & _typeOccupancy[static_cast<int>(PieceType::Ju)]) |
+           (paoAttacks(square, occupied, fileOccupied) & pieces & _typeOccupancy[static_cast<int>(PieceType::Pao)]) |
+           attackedFrom(_maAttackers[square], pieces & _typeOccupancy[static_cast<int>(PieceType::Ma)]) |
+           attackedFrom(_bingAttackers[side][square], pieces & _typeOccupancy[static_cast<int>(PieceType::Bing)]) |
+           attackedFrom(_shuaiMoves[side][square], pieces & _typeOccupancy[static_cast<int>(PieceType::Shuai)]) |
+           attackedFrom(_shiMoves[side][square], pieces & _typeOccupancy[static_cast<int>(PieceType::Shi)]) |
+           attackedFrom(_xiangMoves[side][square], pieces & _typeOccupancy[static_cast<int>(PieceType::Xiang)]);
 }
 
-std::vector<Position> GameState::getMoves(Piece* pieceP, bool doDangerCheck){
-    std::vector<Position> moves;
-    Piece piece = *pieceP;
+bool GameState::inCheck(Side side) const{
+    return isSquareAttacked(shuaiSquare(side), otherSide(side)) || shuaiFacing();
+}
+
+bool GameState::lineOfSight(Piece* pieceP, Position move){
+    makeMove(toSquare(pieceP->pos), toSquare(move));
+    bool result = shuaiFacing();
+    unmakeMove();
+    return result;
+}
+
+bool GameState::selfDanger(Piece* pieceP, Position move){
+    Side side = pieceP->side;
+    makeMove(toSquare(pieceP->pos), toSquare(move));
+    bool result = isSquareAttacked(shuaiSquare(side), otherSide(side)); // own shuai becomes a target
+    unmakeMove();
+    return result;
+}
+
+Bitboard GameState::pieceTargets(int square) const{
+    const Piece& piece = _pieces[_mailbox[square]];
+    int side = static_cast<int>(piece.side);
+    Bitboard occupied = occupancy();
+    Bitboard targets = _emptyBitboard;
     switch (piece.type){ // different movement pattern for each piece
         case PieceType::Shuai:
             // within the palace
-            if (piece.pos.x < 5){
-                moves.push_back(Position{piece.pos.x+1, piece.pos.y});
-            }
-            if (piece.pos.x > 3){
-                moves.push_back(Position{piece.pos.x-1, piece.pos.y});
-            }
-            if (piece.side == Side::Red){
-                if (piece.pos.y > 7){
-                    moves.push_back(Position{piece.pos.x, piece.pos.y-1});
-                }
-                moves.push_back(Position{piece.pos.x, piece.pos.y+1});
-            }else{
-                if (piece.pos.y < 2){
-                    moves.push_back(Position{piece.pos.x, piece.pos.y+1});
-                }
-                moves.push_back(Position{piece.pos.x, piece.pos.y-1});
-            }
+            targets = _shuaiMoves[side][square].targets;
             break;
         case PieceType::Shi:
             // diagonals within the palace
-            if (piece.pos.x == 4){
-                moves.push_back(Position{5, piece.pos.y+1});
-                moves.push_back(Position{5, piece.pos.y-1});
-                moves.push_back(Position{3, piece.pos.y+1});
-                moves.push_back(Position{3, piece.pos.y-1});
-            }else{
-                moves.push_back(Position{4, (piece.side == Side::Red? 8:1)});
-            }
+            targets = _shiMoves[side][square].targets;
             break;
         case PieceType::Xiang:
             // moves 2 boxes diagonally if not blocked, can't cross river
-            if (piece.side != Side::Black || piece.pos.y < 3){
-                if (findPiece(Position{piece.pos.x+1, piece.pos.y+1}) == nullptr){
-                    moves.push_back(Position{piece.pos.x+2, piece.pos.y+2});
-                }
-                if (findPiece(Position{piece.pos.x-1, piece.pos.y+1}) == nullptr){
-                    moves.push_back(Position{piece.pos.x-2, piece.pos.y+2});
-                }
-            }
-            if (piece.side != Side::Red || piece.pos.y > 6){
-                if (findPiece(Position{piece.pos.x+1, piece.pos.y-1}) == nullptr){
-                    moves.push_back(Position{piece.pos.x+2, piece.pos.y-2});
-                }
-                if (findPiece(Position{piece.pos.x-1, piece.pos.y-1}) == nullptr){
-                    moves.push_back(Position{piece.pos.x-2, piece.pos.y-2});
-                }
-            }
+            targets = stepTargets(_xiangMoves[side][square], occupied);
             break;
         case PieceType::Ma:
             // moves in L shape if direct adjacent paths not blocked
-            if (findPiece(Position{piece.pos.x+1, piece.pos.y}) == nullptr){
-                moves.push_back(Position{piece.pos.x+2, piece.pos.y+1});
-                moves.push_back(Position{piece.pos.x+2, piece.pos.y-1});
-            }
-            if (findPiece(Position{piece.pos.x-1, piece.pos.y}) == nullptr){
-                moves.push_back(Position{piece.pos.x-2, piece.pos.y+1});
-                moves.push_back(Position{piece.pos.x-2, piece.pos.y-1});
-            }
-            if (findPiece(Position{piece.pos.x, piece.pos.y+1}) == nullptr){
-                moves.push_back(Position{piece.pos.x+1, piece.pos.y+2});
-                moves.push_back(Position{piece.pos.x-1, piece.pos.y+2});
-            }
-            if (findPiece(Position{piece.pos.x, piece.pos.y-1}) == nullptr){
-                moves.push_back(Position{piece.pos.x+1, piece.pos.y-2});
-                moves.push_back(Position{piece.pos.x-1, piece.pos.y-2});
-            }
+            targets = stepTargets(_maMoves[square], occupied);
             break;
         case PieceType::Ju:
             // continues horizontally/vertically until collision then can capture
-            for (int i=1; i<10; ++i){
-                moves.push_back(Position{piece.pos.x+i, piece.pos.y});
-                if (findPiece(Position{piece.pos.x+i, piece.pos.y}) != nullptr){
-                    break;
-                }
-            }
-            for (int i=1; i<10; ++i){
-                moves.push_back(Position{piece.pos.x-i, piece.pos.y});
-                if (findPiece(Position{piece.pos.x-i, piece.pos.y}) != nullptr){
-                    break;
-                }
-            }
-            for (int i=1; i<10; ++i){
-                moves.push_back(Position{piece.pos.x, piece.pos.y+i});
-                if (findPiece(Position{piece.pos.x, piece.pos.y+i}) != nullptr){
-                    break;
-                }
-            }
-            for (int i=1; i<10; ++i){
-                moves.push_back(Position{piece.pos.x, piece.pos.y-i});
-                if (findPiece(Position{piece.pos.x, piece.pos.y-i}) != nullptr){
-                    break;
-                }
-            }
+            targets = juAttacks(square);
             break;
         case PieceType::Pao:
             // continues horizontally/vertically until collision then can capture the next piece
-            int i;
-            for (i=1; i<10 && findPiece(Position{piece.pos.x+i, piece.pos.y}) == nullptr; ++i){
-                moves.push_back(Position{piece.pos.x+i, piece.pos.y});
-            }
-            for (++i; i<10; ++i){
-                Piece* pieceP = findPiece(Position{piece.pos.x+i, piece.pos.y});
-                if (pieceP != nullptr){
-                    moves.push_back(pieceP->pos);
-                    break;
-                }
-            }
-            for (i=1; i<10 && findPiece(Position{piece.pos.x-i, piece.pos.y}) == nullptr; ++i){
-                moves.push_back(Position{piece.pos.x-i, piece.pos.y});
-            }
-            for (++i; i<10; ++i){
-                Piece* pieceP = findPiece(Position{piece.pos.x-i, piece.pos.y});
-                if (pieceP != nullptr){
-                    moves.push_back(pieceP->pos);
-                    break;
-                }
-            }
-            for (i=1; i<10 && findPiece(Position{piece.pos.x, piece.pos.y+i}) == nullptr; ++i){
-                moves.push_back(Position{piece.pos.x, piece.pos.y+i});
-            }
-            for (++i; i<10; ++i){
-                Piece* pieceP = findPiece(Position{piece.pos.x, piece.pos.y+i});
-                if (pieceP != nullptr){
-                    moves.push_back(pieceP->pos);
-                    break;
-                }
-            }
-            for (i=1; i<10 && findPiece(Position{piece.pos.x, piece.pos.y-i}) == nullptr; ++i){
-                moves.push_back(Position{piece.pos.x, piece.pos.y-i});
-            }
-            for (++i; i<10; ++i){
-                Piece* pieceP = findPiece(Position{piece.pos.x, piece.pos.y-i});
-                if (pieceP != nullptr){
-                    moves.push_back(pieceP->pos);
-                    break;
-                }
-            }
+            targets = (juAttacks(square) & ~occupied) | paoAttacks(square);
             break;
         case PieceType::Bing:
-            if (piece.side == Side::Red){
-                moves.push_back(Position{piece.pos.x, piece.pos.y-1});
-                // crossed the river?
-                if (piece.pos.y < 5){
-                    moves.push_back(Position{piece.pos.x-1, piece.pos.y});
-                    moves.push_back(Position{piece.pos.x+1, piece.pos.y});
-                }
-            }else{
-                moves.push_back(Position{piece.pos.x, piece.pos.y+1});
-                if (piece.pos.y > 4){
-                    moves.push_back(Position{piece.pos.x-1, piece.pos.y});
-                    moves.push_back(Position{piece.pos.x+1, piece.pos.y});
-                }
-            }
+            // forwards, and sideways once across the river
+            targets = _bingMoves[side][square].targets;
             break;
     }
-    // remove invalid moves
-    auto pred = [this, pieceP, doDangerCheck](Position move){
-        if (move.x < 0 || move.x > 8 || move.y < 0 || move.y > 9){ // out of bounds
-            return true;
+    return targets & ~occupancy(piece.side); // cannot capture pieces of same side
+}
+
+bool GameState::legal(Move move) const{
+    int from = move.from(), to = move.to();
+    const Piece& piece = _pieces[_mailbox[from]];
+    Side enemy = otherSide(piece.side);
+    if (testBit(occupancy(enemy, PieceType::Shuai), to)){ // always allowed if targeting enemy shuai b/c that would end the game
+        return true;
+    }
+    Bitboard occupied = (occupancy() & ~squareBit(from)) | squareBit(to);
+    Bitboard fileOccupied = (_fileOccupancy & ~rotatedBit(from)) | rotatedBit(to);
+    int shuai = piece.type == PieceType::Shuai? to : shuaiSquare(piece.side);
+    // anything of the enemy's on the target has just been captured
+    if ((attackersTo(shuai, enemy, occupied, fileOccupied) & ~squareBit(to)) != 0){
+        return false;
+    }
+    int enemyShuai = shuaiSquare(enemy);
+    return _pieces[static_cast<int>(enemy)].captured || fileOf(enemyShuai) != fileOf(shuai) || !testBit(juAttacks(shuai, occupied, fileOccupied), enemyShuai);
+}
+
+bool GameState::hasLegalMove(Side side) const{
+    Bitboard pieces = occupancy(side);
+    while (pieces != 0){
+        int from = popLsb(pieces);
+        Bitboard targets = pieceTargets(from);
+        while (targets != 0){
+            if (legal(Move(from, popLsb(targets)))){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void GameState::updateStatus() const{
+    if (_status.known){
+        return;
+    }
+    _status.check = _history[_plies & (_historySize-1)].check;
+    bool canMove = hasLegalMove(_currentTurn);
+    _status.checkmate = _status.check && !canMove;
+    _status.stalemate = !_status.check && !canMove;
+    _status.ruling = canMove? judgeRepetition(_gameRepetitions) : Ruling::None;
+    _status.known = true;
+}
+
+bool GameState::isLegal(Move move) const{
+    const Piece* piece = pieceAt(move.from());
+    return piece != nullptr && piece->side == _currentTurn && testBit(pieceTargets(move.from()), move.to()) && legal(move);
+}
+
+void GameState::addLegalMoves(int from, Bitboard targets, MoveList& moves){
+    while (targets != 0){
+        Move move(from, popLsb(targets));
+        if (legal(move)){
+            moves.push(move);
         }
+    }
+}
+
+void GameState::generateLegalMoves(Side side, MoveList& moves){
+    Bitboard pieces = occupancy(side);
+    while (pieces != 0){
+        int from = popLsb(pieces);
+        addLegalMoves(from, pieceTargets(from), moves);
+    }
+}
+
+void GameState::generateCaptures(Side side, MoveList& moves){
+    Bitboard enemies = occupancy(otherSide(side));
+    Bitboard pieces = occupancy(side);
+    while (pieces != 0){
+        int from = popLsb(pieces);
+        addLegalMoves(from, pieceTargets(from) & enemies, moves);
+    }
+}
+
+void GameState::generateQuiets(Side side, MoveList& moves){
+    Bitboard empties = ~occupancy();
+    Bitboard pieces = occupancy(side);
+    while (pieces != 0){
+        int from = popLsb(pieces);
+        addLegalMoves(from, pieceTargets(from) & empties, moves);
+    }
+}
+
+// squares strictly between two squares on the same rank or file
+static Bitboard lineBetween(int a, int b){
+    int step = fileOf(a) == fileOf(b)? _boardFiles:1;
+    if (a > b){
+        std::swap(a, b);
+    }
+    Bitboard between = _emptyBitboard;
+    for (int square=a+step; square<b; square+=step){
+        between |= squareBit(square);
+    }
+    return between;
+}
+
+void GameState::generateEvasions(Side side, MoveList& moves){
+    Side enemy = otherSide(side);
+    int shuai = shuaiSquare(side);
+    Bitboard occupied = occupancy();
+    Bitboard evasionTargets = _emptyBitboard; // capturing a checker or blocking it
+    Bitboard screens = _emptyBitboard; // own pieces a checking pao jumps over, any move of them can help
+    Bitboard checkers = juAttacks(shuai) & occupancy(enemy, PieceType::Ju);
+    while (checkers != 0){
+        int checker = popLsb(checkers);
+        evasionTargets |= squareBit(checker) | lineBetween(shuai, checker);
+    }
+    checkers = paoAttacks(shuai) & occupancy(enemy, PieceType::Pao);
+    while (checkers != 0){
+        int checker = popLsb(checkers);
+        Bitboard between = lineBetween(shuai, checker);
+        evasionTargets |= squareBit(checker) | (between & ~occupied); // a second screen also blocks
+        screens |= between & occupancy(side);
+    }
+    Bitboard ma = occupancy(enemy, PieceType::Ma);
+    const StepMoves& maAttackers = _maAttackers[shuai];
+    for (int i=0; i<maAttackers.count; ++i){
+        if (testBit(ma, maAttackers.to[i]) && !testBit(occupied, maAttackers.block[i])){
+            evasionTargets |= squareBit(maAttackers.to[i]) | squareBit(maAttackers.block[i]); // capture or block the horse leg
+        }
+    }
+    evasionTargets |= _bingAttackers[static_cast<int>(enemy)][shuai].targets & occupancy(enemy, PieceType::Bing);
+    // shi and xiang cannot reach the other palace, and the shuai can never be adjacent to each other
+    Bitboard pieces = occupancy(side);
+    while (pieces != 0){
+        int from = popLsb(pieces);
+        Bitboard targets = pieceTargets(from);
+        if (from != shuai && !testBit(screens, from)){
+            targets &= evasionTargets;
+        }
+        addLegalMoves(from, targets, moves);
+    }
+}
+
+std::vector<Position> GameState::getMoves(Piece* pieceP, bool doDangerCheck){
+    std::vector<Position> moves;
+    if (pieceP->captured){
+        return moves;
+    }
+    Bitboard targets = pieceTargets(toSquare(pieceP->pos));
+    while (targets != 0){
+        Position move = toPosition(popLsb(targets));
         if (lineOfSight(pieceP, move)){ // check if move causes line of sight
-            return true;
+            continue;
         }
-        Piece* otherP = findPiece(move);
         if (doDangerCheck && selfDanger(pieceP, move)){ // check if move endangers own shuai
-            return !(otherP != nullptr && otherP->type == PieceType::Shuai && otherP->side != pieceP->side); // only allowed if targeting enemy shuai b/c that would end the game
+            Piece* otherP = findPiece(move);
+            if (otherP == nullptr || otherP->type != PieceType::Shuai){ // only allowed if targeting enemy shuai b/c that would end the game
+                continue;
+            }
         }
-        return otherP != nullptr && otherP->side == pieceP->side; // check if capturing piece of same side
-    };
-    moves.erase(std::remove_if(moves.begin(), moves.end(), pred), moves.end());
+        moves.push_back(move);
+    }
     return moves;
 }
 
-void GameState::performMove(Piece* pieceP, Position move, bool temporary){
-    // captured a piece?
-    Piece* otherP = findPiece(move);
-    if (otherP != nullptr){
-        otherP->captured = true;
-    }
-    _pieceGrid[pieceP->pos.x][pieceP->pos.y] = nullptr;
-    _pieceGrid[move.x][move.y] = pieceP;
-    pieceP->pos = move;
-    if (!temporary){
-        // check if checking enemy shuai
-        _check = false;
-        for (Piece& piece : _pieces){
-            if (piece.captured || piece.side != pieceP->side){ // ignore captured/pieces on enemy side
-                continue;
+void GameState::performMove(Piece* pieceP, Position move){
+    Bitboard before = chaseTargets(toSquare(pieceP->pos));
+    uint8_t captured = movePiece(static_cast<int>(pieceP - _pieces.data()), toSquare(move));
+    _status.known = false;
+    _status.checking = pieceP->side;
+    switchTurns();
+    recordMove(toSquare(move), before, captured);
+}
+
+void GameState::performMove(Move move){
+    performMove(&_pieces[_mailbox[move.from()]], toPosition(move.to()));
+}
+
+void GameState::makeMove(int from, int to){
+    assert(_undoSize < _maxUndo);
+    UndoRecord& record = _undoStack[_undoSize++];
+    record.piece = _mailbox[from];
+    record.from = from;
+    record.status = _status;
+    Bitboard before = chaseTargets(from);
+    record.captured = movePiece(record.piece, to);
+    _status.known = false;
+    _status.checking = _currentTurn;
+    switchTurns();
+    recordMove(to, before, record.captured);
+}
+
+void GameState::makeMove(Move move){
+    makeMove(move.from(), move.to());
+}
+
+void GameState::makeNullMove(){
+    assert(_undoSize < _maxUndo);
+    UndoRecord& record = _undoStack[_undoSize++];
+    record.piece = _noPiece;
+    record.captured = _noPiece;
+    record.status = _status;
+    _status.known = false;
+    _status.checking = _currentTurn;
+    switchTurns();
+    // a pass is not a real move, so repetitions are not looked for across it, but the 60 move count goes on
+    uint8_t quietPlies = _history[_plies & (_historySize-1)].quietPlies;
+    _history[++_plies & (_historySize-1)] = HistoryEntry{_hash, 0, static_cast<uint8_t>(std::min<int>(quietPlies + 1, _historySize-1)), 0, false};
+}
+
+Ruling GameState::judgeRepetition(int repetitions) const{
+    const HistoryEntry& current = _history[_plies & (_historySize-1)];
+    if (current.quietPlies >= _quietPlyLimit){
+        return Ruling::Draw;
+    }
+    // the side to move made the odd plies back, the other side the even ones
+    int found = 0;
+    int reach = std::min<int>(current.repetitionPlies, _plies); // a halfmove clock from a FEN reaches back past the start
+    for (int back=4; back<=reach; back+=2){
+        if (_history[(_plies-back) & (_historySize-1)].hash != current.hash || ++found < repetitions){
+            continue;
+        }
+        bool ourChecks = true, theirChecks = true;
+        uint32_t ourChases = ~uint32_t{0}, theirChases = ~uint32_t{0};
+        for (int i=0; i<back; ++i){
+            const HistoryEntry& entry = _history[(_plies-i) & (_historySize-1)];
+            if (i % 2 == 0){
+                theirChecks &= entry.check;
+                theirChases &= entry.chased;
+            }else{
+                ourChecks &= entry.check;
+                ourChases &= entry.chased;
+            }
+        }
+        if (ourChecks != theirChecks){
+            return theirChecks? Ruling::Win : Ruling::Loss;
+        }
+        if (!ourChecks && (ourChases != 0) != (theirChases != 0)){
+            return theirChases != 0? Ruling::Win : Ruling::Loss;
+        }
+        return Ruling::Draw;
+    }
+    return Ruling::None;
+}
+
+void GameState::unmakeMove(){
+    const UndoRecord& record = _undoStack[--_undoSize];
+    if (record.piece != _noPiece){
+        int to = toSquare(_pieces[record.piece].pos);
+        removePiece(record.piece);
+        placePiece(record.piece, record.from);
+        if (record.captured != _noPiece){
+            _pieces[record.captured].captured = false;
+            placePiece(record.captured, to);
+        }
+    }
+    _status = record.status;
+    --_plies;
+    switchTurns();
+}
+
+void GameState::setup(const std::array<Piece, _defaultSetupSize>& pieces, Side turn){
+    _pieces = pieces;
+    std::fill(std::begin(_mailbox), std::end(_mailbox), _noPiece);
+    std::fill(std::begin(_sideOccupancy), std::end(_sideOccupancy), _emptyBitboard);
+    std::fill(std::begin(_typeOccupancy), std::end(_typeOccupancy), _emptyBitboard);
+    _fileOccupancy = _emptyBitboard;
+    _hash = turn == Side::Black? _zobrist.blackToMove:0;
+    _midgame = _endgame = _phase = 0;
+    std::fill(&_accumulator[0][0], &_accumulator[0][0] + 2*_nnueHidden, 0); // both shuai come first in _pieces and rebuild their side when placed
+    for (int i=0; i<_defaultSetupSize; ++i){
+        if (!_pieces[i].captured){
+            placePiece(i, toSquare(_pieces[i].pos));
+        }
+    }
+    _undoSize = 0;
+    _currentTurn = turn;
+    _status.known = false;
+    _status.checking = otherSide(turn);
+    _plies = 0;
+    _startPly = static_cast<int>(turn);
+    _history[0] = HistoryEntry{_hash, 0, 0, 0, inCheck(turn)};
+}
+
+void GameState::reset(){
+    std::array<Piece, _defaultSetupSize> pieces;
+    std::copy(_defaultSetup, _defaultSetup+_defaultSetupSize, pieces.begin());
+    setup(pieces, Side::Red);
+}
+
+static bool fenPieceType(char c, PieceType& type){
+    switch (c | 0x20){ // lowercase
+        case 'k': type = PieceType::Shuai; return true;
+        case 'a': type = PieceType::Shi; return true;
+        case 'b': case 'e': type = PieceType::Xiang; return true;
+        case 'n': case 'h': type = PieceType::Ma; return true;
+        case 'r': type = PieceType::Ju; return true;
+        case 'c': type = PieceType::Pao; return true;
+        case 'p': type = PieceType::Bing; return true;
+        default: return false;
+    }
+}
+
+bool GameState::setPosition(const Piece* pieces, int count, Side turn){
+    // every piece takes an unused slot of the same kind from the default setup, leftover slots stay captured
+    std::array<Piece, _defaultSetupSize> slots;
+    std::copy(_defaultSetup, _defaultSetup+_defaultSetupSize, slots.begin());
+    for (Piece& slot : slots){
+        slot.captured = true;
+    }
+    Bitboard occupied = _emptyBitboard, fileOccupied = _emptyBitboard;
+    Bitboard pieceOccupancy[2][7]{}; // by side and type
+    for (int i=0; i<count; ++i){
+        const Piece& piece = pieces[i];
+        if (!onBoard(piece.pos.x, piece.pos.y) || testBit(occupied, toSquare(piece.pos)) || !canStand(piece.side, piece.type, piece.pos.x, piece.pos.y)){
+            return false;
+        }
+        int square = toSquare(piece.pos);
+        occupied |= squareBit(square);
+        fileOccupied |= rotatedBit(square);
+        pieceOccupancy[static_cast<int>(piece.side)][static_cast<int>(piece.type)] |= squareBit(square);
+        auto slot = std::find_if(slots.begin(), slots.end(), [&piece](const Piece& slot){
+            return slot.captured && slot.type == piece.type && slot.side == piece.side;
+        });
+        if (slot == slots.end()){ // more of this piece than a side starts with
+            return false;
+        }
+        *slot = Piece{piece.pos, piece.type, piece.side, false};
+    }
+    if (slots[0].captured || slots[1].captured){
+        return false;
+    }
+    // the side not to move may not be in check, worked out before setup so a rejected position leaves this one as it was
+    // shi, xiang and shuai cannot reach the other palace, the shuai only by facing the other
+    int redShuai = toSquare(slots[0].pos), blackShuai = toSquare(slots[1].pos);
+    if (fileOf(redShuai) == fileOf(blackShuai) && testBit(juAttacks(redShuai, occupied, fileOccupied), blackShuai)){
+        return false;
+    }
+    int mover = static_cast<int>(turn);
+    int shuai = turn == Side::Red? blackShuai : redShuai;
+    auto attackedFrom = [occupied](const StepMoves& steps, Bitboard attackers){
+        for (int i=0; i<steps.count; ++i){
+            if (testBit(attackers, steps.to[i]) && (steps.block[i] == _noBlock || !testBit(occupied, steps.block[i]))){
+                return true;
             }
-            std::vector<Position> moves = getMoves(&piece);
-            if (std::find(moves.begin(), moves.end(), _pieces[pieceP->side == Side::Red? 1:0].pos) != moves.end()){
-                _check = true;
-                _checking = pieceP->side;
-                break;
+        }
+        return false;
+    };
+    const Bitboard (&attackers)[7] = pieceOccupancy[mover];
+    if ((juAttacks(shuai, occupied, fileOccupied) & attackers[static_cast<int>(PieceType::Ju)]) != 0 ||
+        (paoAttacks(shuai, occupied, fileOccupied) & attackers[static_cast<int>(PieceType::Pao)]) != 0 ||
+        attackedFrom(_maAttackers[shuai], attackers[static_cast<int>(PieceType::Ma)]) ||
+        attackedFrom(_bingAttackers[mover][shuai], attackers[static_cast<int>(PieceType::Bing)])){
+        return false;
+    }
+    setup(slots, turn);
+    return true;
+}
+
+bool GameState::loadFen(std::string_view fen){
+    Piece pieces[_defaultSetupSize];
+    int count = 0;
+    int x = 0, y = 0;
+    size_t i = 0;
+    for (; i < fen.size() && fen[i] != ' '; ++i){
+        char c = fen[i];
+        PieceType type;
+        if (c == '/'){
+            if (x != _boardFiles || ++y >= _boardRanks){
+                return false;
             }
+            x = 0;
+        }else if (c >= '1' && c <= '9'){
+            x += c - '0';
+            if (x > _boardFiles){
+                return false;
+            }
+        }else if (fenPieceType(c, type) && x < _boardFiles && count < _defaultSetupSize){
+            Side side = (c >= 'A' && c <= 'Z')? Side::Red:Side::Black;
+            pieces[count++] = Piece{Position{x, y}, type, side, false};
+            ++x;
+        }else{
+            return false;
         }
-        if (_check){
-            // check if leads to checkmate
-            _checkmate = true;
-            for (Piece& piece : _pieces){
-                if (piece.captured || piece.side == pieceP->side){ // ignore captured/pieces on same side
-                    continue;
-                }
-                if (!getMoves(&piece).empty()){ // opponent still has valid moves
-                    _checkmate = false;
-                    break;
-                }
+    }
+    if (y != _boardRanks-1 || x != _boardFiles){
+        return false;
+    }
+    Side turn = Side::Red;
+    for (; i < fen.size() && fen[i] == ' '; ++i);
+    if (i < fen.size()){
+        if (fen[i] == 'b'){
+            turn = Side::Black;
+        }else if (fen[i] != 'w' && fen[i] != 'r'){
+            return false;
+        }
+        ++i;
+    }
+    // then "- -" left over from chess, which some writers leave out, the halfmove clock and the move number
+    int numbers[2]{0, 1};
+    int numberCount = 0;
+    while (i < fen.size()){
+        for (; i < fen.size() && fen[i] == ' '; ++i);
+        size_t end = std::min(fen.find(' ', i), fen.size());
+        if (i == end){
+            break;
+        }
+        if (fen.substr(i, end-i) != "-"){
+            if (numberCount == 2 || std::from_chars(fen.data()+i, fen.data()+end, numbers[numberCount]).ptr != fen.data()+end ||
+                numbers[numberCount] < (numberCount == 0? 0:1)){
+                return false;
             }
+            ++numberCount;
         }
-        switchTurns();
+        i = end;
+    }
+    if (!setPosition(pieces, count, turn)){
+        return false;
     }
+    _history[0].quietPlies = _history[0].repetitionPlies = static_cast<uint8_t>(std::min(numbers[0], _historySize-1));
+    _startPly = 2*(numbers[1]-1) + static_cast<int>(turn);
+    return true;
 }
 
-void GameState::reset(){
-    _pieces.clear();
-    _pieces.assign(_defaultSetup, _defaultSetup+_defaultSetupSize);
-    _pieceGrid.assign(9, std::vector<Piece*>(10, nullptr));
-    for (Piece& piece : _pieces){
-        _pieceGrid[piece.pos.x][piece.pos.y] = &piece;
+int GameState::writeFen(char* out) const{
+    constexpr static char letters[] = "kabnrcp"; // by PieceType
+    char* p = out;
+    for (int y=0; y<_boardRanks; ++y){
+        int empty = 0;
+        for (int x=0; x<_boardFiles; ++x){
+            const Piece* piece = pieceAt(squareOf(x, y));
+            if (piece == nullptr){
+                ++empty;
+                continue;
+            }
+            if (empty != 0){
+                *p++ = static_cast<char>('0' + empty);
+                empty = 0;
+            }
+            char letter = letters[static_cast<int>(piece->type)];
+            *p++ = piece->side == Side::Red? static_cast<char>(letter - 0x20) : letter; // uppercase for red
+        }
+        if (empty != 0){
+            *p++ = static_cast<char>('0' + empty);
+        }
+        if (y != _boardRanks-1){
+            *p++ = '/';
+        }
+    }
+    *p++ = ' ';
+    *p++ = _currentTurn == Side::Red? 'w':'b';
+    for (char c : {' ', '-', ' ', '-', ' '}){
+        *p++ = c;
     }
-    _currentTurn = Side::Red;
-    _check = false;
-    _checkmate = false;
+    p = std::to_chars(p, out+_maxFenLength, _history[_plies & (_historySize-1)].quietPlies).ptr;
+    *p++ = ' ';
+    p = std::to_chars(p, out+_maxFenLength, 1 + (_startPly + _plies)/2).ptr;
+    return static_cast<int>(p - out);
+}
+
+std::string GameState::fen() const{
+    char buffer[_maxFenLength];
+    return std::string(buffer, writeFen(buffer));
 }
 
-std::vector<Piece>& GameState::pieces(){
+std::array<Piece, GameState::_defaultSetupSize>& GameState::pieces(){
+    return _pieces;
+}
+
+const std::array<Piece, GameState::_defaultSetupSize>& GameState::pieces() const{
     return _pieces;
 }
 
@@ -311,14 +799,51 @@ Side GameState::currentTurn() const{
     return _currentTurn;
 }
 
+uint64_t GameState::hash() const{
+    return _hash;
+}
+
+int GameState::midgameScore() const{
+    return _midgame;
+}
+
+int GameState::endgameScore() const{
+    return _endgame;
+}
+
+int GameState::phase() const{
+    return _phase;
+}
+
+const int16_t* GameState::accumulator(Side side) const{
+    return _accumulator[static_cast<int>(side)];
+}
+
 bool GameState::check() const{
-    return _check;
+    updateStatus();
+    return _status.check;
 }
 
 bool GameState::checkmate() const{
-    return _checkmate;
+    updateStatus();
+    return _status.checkmate;
+}
+
+bool GameState::stalemate() const{
+    updateStatus();
+    return _status.stalemate;
+}
+
+Ruling GameState::ruling() const{
+    updateStatus();
+    return _status.ruling;
+}
+
+bool GameState::gameOver() const{
+    updateStatus();
+    return _status.checkmate || _status.stalemate || _status.ruling != Ruling::None;
 }
 
 Side GameState::checking() const{
-    return _checking;
+    return _status.checking;
 }
@@ -7,7 +7,19 @@
 
 #pragma once
 
+#include <array>
 #include <vector>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <cstdint>
+
+#include "bitboard.hpp"
+#include "move_tables.hpp"
+#include "move.hpp"
+#include "zobrist.hpp"
+#include "piece_square_tables.hpp"
+#include "nnue.hpp"
 
 enum class PieceType{
     Shuai,
@@ -24,12 +36,51 @@ enum class Side{
     Black,
 };
 
+constexpr Side otherSide(Side side){
+    return side == Side::Red? Side::Black:Side::Red;
+}
+
+// verdict for the side to move on a repeated or drawn out position
+enum class Ruling{
+    None,
+    Draw,
+    Win, // the other side kept checking or chasing while this side did not
+    Loss,
+};
+
 struct Position{
     int x, y;
     
     bool operator==(Position other) const;
 };
 
+constexpr int toSquare(Position pos){
+    return squareOf(pos.x, pos.y);
+}
+
+constexpr Position toPosition(int square){
+    return Position{fileOf(square), rankOf(square)};
+}
+
+// can a piece of this side and type ever stand on (x, y) in a game: shuai and shi in their palace points, xiang on its seven points,
+// bing on its starting files until across the river
+constexpr bool canStand(Side side, PieceType type, int x, int y){
+    int s = static_cast<int>(side);
+    int backRankDistance = side == Side::Red? _boardRanks-1 - y : y;
+    switch (type){
+        case PieceType::Shuai:
+            return inPalace(s, x, y);
+        case PieceType::Shi: // the corners and centre of the palace
+            return inPalace(s, x, y) && (x + backRankDistance) % 2 == 1;
+        case PieceType::Xiang:
+            return ownSide(s, y) && backRankDistance % 2 == 0 && x % 4 == (backRankDistance % 4 == 0? 2:0);
+        case PieceType::Bing:
+            return !ownSide(s, y) || (backRankDistance >= 3 && x % 2 == 0);
+        default:
+            return true;
+    }
+}
+
 struct Piece{
     Position pos;
     PieceType type;
@@ -39,14 +90,34 @@ struct Piece{
     bool operator==(Piece other) const;
 };
 
+// holds no pointers, copies are independent and cost one flat copy so each search thread can take its own
 class GameState{
-    std::vector<Piece> _pieces;
-    std::vector<std::vector<Piece*>> _pieceGrid; // nullptr if position on grid does not have a piece
+    constexpr static int _defaultSetupSize = 32;
+    constexpr static uint8_t _noPiece = 0xFF;
+    
+    std::array<Piece, _defaultSetupSize> _pieces;
+    // board representation, all move generation reads from these
+    uint8_t _mailbox[_squareCount]; // index into _pieces, _noPiece if square is empty
+    Bitboard _sideOccupancy[2];
+    Bitboard _typeOccupancy[7]; // both sides
+    Bitboard _fileOccupancy; // both sides, rotated so each file is 10 consecutive bits (x*10 + y)
+    uint64_t _hash; // zobrist key, kept up to date by placePiece/removePiece/switchTurns
+    // material and piece-square sums from red's point of view plus the game phase, kept up to date by placePiece/removePiece
+    int _midgame, _endgame, _phase;
+    // first network layer for each side's perspective, only kept while a network is loaded
+    alignas(32) int16_t _accumulator[2][_nnueHidden];
     Side _currentTurn;
-    bool _check, _checkmate;
-    Side _checking;
     
-    constexpr static int _defaultSetupSize = 32;
+    // result of the last move, worked out on first read so applying a move costs nothing until someone asks
+    struct Status{
+        bool known;
+        bool check, checkmate, stalemate; // for the side to move
+        Ruling ruling;
+        Side checking; // side that made the last move
+    };
+    
+    mutable Status _status;
+    
     constexpr static Piece _defaultSetup[_defaultSetupSize]{
         Piece{Position{4, 9}, PieceType::Shuai, Side::Red, false},
         Piece{Position{4, 0}, PieceType::Shuai, Side::Black, false},
@@ -82,23 +153,130 @@ class GameState{
         Piece{Position{8, 3}, PieceType::Bing, Side::Black, false},
     };
     
-    class TempPiecesState{
-        GameState* _gameState;
-        std::vector<Piece> _prevPiecesState;
-        std::vector<std::vector<Piece*>> _prevPieceGridState;
-        
-    public:
-        TempPiecesState(GameState* stateP, Piece* pieceP, Position move);
-        
-        ~TempPiecesState();
+    constexpr static int _maxUndo = 256;
+    
+    // everything needed to revert a move made by makeMove
+    struct UndoRecord{
+        uint8_t piece; // index into _pieces, _noPiece for a null move
+        uint8_t from;
+        uint8_t captured; // index into _pieces, _noPiece if nothing was captured
+        Status status;
     };
     
+    std::array<UndoRecord, _maxUndo> _undoStack;
+    int _undoSize;
+    
+    constexpr static int _historySize = 256; // power of 2, must cover _quietPlyLimit and the deepest search
+    constexpr static int _quietPlyLimit = 120; // 60 moves each without a capture is a draw
+    constexpr static int _gameRepetitions = 2; // the game ends when a position comes up for the third time
+    
+    // one entry per position reached, so repetitions are found by stepping back two plies at a time
+    struct HistoryEntry{
+        uint64_t hash;
+        uint32_t chased; // pieces the move that led here newly threatens to win, by index into _pieces
+        uint8_t quietPlies; // since the last capture, for the 60 move rule, at most _historySize-1
+        uint8_t repetitionPlies; // since the last capture or null move, no repetition can reach further back
+        bool check; // the move that led here gave check
+    };
+    
+    std::array<HistoryEntry, _historySize> _history; // ring buffer indexed by _plies
+    int _plies;
+    int _startPly; // plies played before the position that was set up, from the FEN move number
+    
     void switchTurns();
+    
+    void placePiece(int index, int square);
+    
+    void removePiece(int index);
+    
+    // adds or removes the piece's feature in both accumulators, a shuai placed rebuilds its own side's
+    void updateAccumulators(int index, int square, bool add);
+    
+    void refreshAccumulator(int perspective);
+    
+    // moves piece to square, returns index of captured piece or _noPiece
+    uint8_t movePiece(int index, int square);
+    
+    // enemy pieces that the piece on square attacks and that count as chased, 0 for shuai and bing which may chase freely
+    Bitboard chaseTargets(int square) const;
+    
+    // pieces newly attacked by the piece on square that are unprotected or a ju attacked by a ma or pao
+    uint32_t chasedPieces(int square, Bitboard before) const;
+    
+    // pushes the position after a move onto _history, before is chaseTargets of the piece where it came from
+    void recordMove(int square, Bitboard before, uint8_t captured);
+    
+    // move of a piece from pieceTargets leaves its own shuai safe, answered with an attack query on the board after the move
+    bool legal(Move move) const;
+    
+    // stops at the first legal move found
+    bool hasLegalMove(Side side) const;
+    
+    void updateStatus() const;
+    
+    void addLegalMoves(int from, Bitboard targets, MoveList& moves);
+    
+    // replaces the whole position, pieces marked captured are left off the board
+    void setup(const std::array<Piece, _defaultSetupSize>& pieces, Side turn);
+    
+    // both shuai on the same file with nothing between
+    bool shuaiFacing() const;
 public:
     GameState();
     
     Piece* findPiece(Position pos);
     
+    Piece* pieceAt(int square);
+    
+    const Piece* pieceAt(int square) const;
+    
+    Bitboard occupancy() const;
+    
+    Bitboard occupancy(Side side) const;
+    
+    Bitboard occupancy(Side side, PieceType type) const;
+    
+    int shuaiSquare(Side side) const;
+    
+    // occupancy() rotated as in rotatedBit
+    Bitboard fileOccupancy() const;
+    
+    // empty squares and the first piece along each line from square
+    Bitboard juAttacks(int square) const;
+    
+    // the first piece behind a screen along each line from square
+    Bitboard paoAttacks(int square) const;
+    
+    // same with the board given as occupied and its rotated copy, so pieces can be lifted off without moving them
+    static Bitboard juAttacks(int square, Bitboard occupied, Bitboard fileOccupied);
+    
+    static Bitboard paoAttacks(int square, Bitboard occupied, Bitboard fileOccupied);
+    
+    // can any piece of bySide move to square, ignoring whether that move would be legal
+    bool isSquareAttacked(int square, Side bySide) const;
+    
+    // every piece of bySide left in occupied that can move to square, with ma legs, xiang eyes and pao screens taken from occupied
+    Bitboard attackersTo(int square, Side bySide, Bitboard occupied, Bitboard fileOccupied) const;
+    
+    // shuai of side is attacked or facing the other shuai
+    bool inCheck(Side side) const;
+    
+    // pseudo-legal destinations of the piece on square, excluding its own pieces
+    Bitboard pieceTargets(int square) const;
+    
+    // move is legal for the side to move, for moves from outside the generators such as hash moves and killers
+    bool isLegal(Move move) const;
+    
+    // move generators append legal moves of side to the list and never allocate
+    void generateLegalMoves(Side side, MoveList& moves);
+    
+    void generateCaptures(Side side, MoveList& moves);
+    
+    void generateQuiets(Side side, MoveList& moves);
+    
+    // only for when side is in check: shuai moves, captures of a checker, blocks of its line or horse leg and moves of a pao screen
+    void generateEvasions(Side side, MoveList& moves);
+    
     // moving a piece would cause line of sight?
     bool lineOfSight(Piece* pieceP, Position move);
     
@@ -107,17 +285,81 @@ public:
     
     std::vector<Position> getMoves(Piece* pieceP, bool doDangerCheck = true);
     
-    void performMove(Piece* pieceP, Position move, bool temporary = false);
+    void performMove(Piece* pieceP, Position move);
+    
+    // plays a move for good, with no undo record, so a whole game of any length can be replayed
+    void performMove(Move move);
+    
+    // plays a move and switches turns, O(1) and reverted by unmakeMove
+    void makeMove(int from, int to);
+    
+    void makeMove(Move move);
+    
+    // draw by the 60 move rule, or the verdict on a position that has occurred repetitions times before since the last capture
+    // a side that checked on every move of the cycle loses unless the other did too, then the same for chasing one piece, otherwise a draw
+    // only steps back two plies at a time through the last quietPlies entries, cheap enough for every search node
+    Ruling judgeRepetition(int repetitions) const;
+    
+    // passes the turn, for null move pruning
+    void makeNullMove();
+    
+    void unmakeMove();
     
     void reset();
     
-    std::vector<Piece>& pieces();
+    // replaces the position with count pieces (captured is ignored), both shuai must be among them
+    // returns false and leaves the position untouched if it could not come up in a game: two pieces share a square, a side has more
+    // of a piece than it starts with, a piece stands where canStand says it cannot, or the side not to move is in check
+    bool setPosition(const Piece* pieces, int count, Side turn);
+    
+    // e.g. "rnbakabnr/9/1c5c1/p1p1p1p1p/9/9/P1P1P1P1P/1C5C1/9/RNBAKABNR w - - 0 1", returns false and leaves the position untouched if invalid
+    // the fields after the side to move are optional, the halfmove clock counts towards the 60 move rule
+    // never allocates, so archives of millions of positions can be read with one GameState
+    bool loadFen(std::string_view fen);
+    
+    constexpr static int _maxFenLength = 128;
+    
+    // writes the position as loadFen reads it without a terminating null, returns the length, at most _maxFenLength
+    int writeFen(char* out) const;
+    
+    std::string fen() const;
+    
+    std::array<Piece, _defaultSetupSize>& pieces();
+    
+    const std::array<Piece, _defaultSetupSize>& pieces() const;
     
     Side currentTurn() const;
     
+    // identical positions with the same side to move have the same hash
+    uint64_t hash() const;
+    
+    // sums of _pieceSquare over every piece on the board, red's point of view
+    int midgameScore() const;
+    
+    int endgameScore() const;
+    
+    // _maxPhase with every ju, ma and pao on the board, down to 0 without them
+    int phase() const;
+    
+    // network input layer as seen by side, meaningless unless a network is loaded
+    const int16_t* accumulator(Side side) const;
+    
+    // status of the side to move, computed on the first call after a move
+    // these read like const but fill in _status, so two threads must not call them on the same state at once
     bool check() const;
     
     bool checkmate() const;
     
+    // no legal moves without being in check, which loses just like checkmate
+    bool stalemate() const;
+    
+    // threefold repetition and the 60 move rule
+    Ruling ruling() const;
+    
+    bool gameOver() const;
+    
+    // side that made the last move, the one giving check or winning if there is one
     Side checking() const;
 };
+
+static_assert(std::is_trivially_copyable_v<GameState>, "GameState is copied into every search thread");
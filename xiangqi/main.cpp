@@ -5,8 +5,24 @@
 //  Created by Colin Xie on 7/9/24.
 //
 #include <iostream>
+#include <cstring>
+#include <stdexcept>
 
 #include "game.hpp"
+#include "perft.hpp"
+#include "bench.hpp"
+#include "book_builder.hpp"
+#include "tablebase.hpp"
+#include "tablebase_generator.hpp"
+#include "match.hpp"
+#include "game_archive.hpp"
+#include "position_index.hpp"
+#include "selfplay.hpp"
+#include "annotate.hpp"
+#include "nnue.hpp"
+
+constexpr static char _networkPath[] = "assets/xiangqi.nnue";
+constexpr static char _tablebasePath[] = "assets/tablebases";
 
 /*
 void testSockets(){
@@ -59,8 +75,53 @@ void testSockets(){
 */
 
 // ./main [port] [is_IPv6] [IP_address]
+// ./main perft <depth> [--fen "<fen>"] [--divide] [--threads <n>]
+// ./main bench [--depth <d>] [--threads <n>] [--fen "<fen>"] [--hash <mb>] [--huge-pages]
+// ./main book <games> <book> [--plies <n>] [--memory <mb>]
+// ./main tablebase <material>... [--threads <n>] [--directory <dir>]
+// ./main archive convert <games> <archive> | replay <archive> [--threads <n>] [--verify]
+// ./main index build <archive> <index> [--plies <n>] [--threads <n>] [--memory <mb>] | query <index> [--fen "<fen>"] [--moves <moves...>]
+// ./main selfplay <out> [--games <n>] [--threads <n>] [--nodes <n>] [--depth <d>] [--random-plies <n>] ...
+// ./main annotate <archive> <out> [--threads <n>] [--nodes <n>] [--depth <d>] [--time <seconds>] [--hash <mb>] [--huge-pages]
+// ./main match --first <player> --second <player> [--games <n>] [--concurrency <n>] [--sprt <elo0> <elo1>] [--log <file>] ...
 int main(int argc, const char* argv[]) {
     //testSockets(); return 0;
+    // the tools report bad arguments and failed files by throwing
+    try{
+        // tools that never evaluate run before the network is loaded so moves do not update its accumulators
+        if (argc >= 2 && strcmp(argv[1], "perft") == 0){ // move generator test/benchmark, no window
+            return runPerft(argc-2, argv+2);
+        }
+        if (argc >= 2 && strcmp(argv[1], "book") == 0){ // opening book from a file of games, no window
+            return runBookBuilder(argc-2, argv+2);
+        }
+        if (argc >= 2 && strcmp(argv[1], "tablebase") == 0){ // endgame tables by retrograde analysis, no window
+            return runTablebaseGenerator(argc-2, argv+2);
+        }
+        if (argc >= 2 && strcmp(argv[1], "archive") == 0){ // binary game archives from text and replaying them, no window
+            return runArchive(argc-2, argv+2);
+        }
+        if (argc >= 2 && strcmp(argv[1], "index") == 0){ // position index over an archive and lookups in it, no window
+            return runPositionIndex(argc-2, argv+2);
+        }
+        loadNetwork(_networkPath); // handcrafted evaluation if there is none
+        loadTablebases(_tablebasePath); // searched normally if there are none
+        if (argc >= 2 && strcmp(argv[1], "bench") == 0){ // search thread scaling report, no window
+            return runBench(argc-2, argv+2);
+        }
+        if (argc >= 2 && strcmp(argv[1], "match") == 0){ // engine against engine games with an SPRT, no window
+            return runMatch(argc-2, argv+2);
+        }
+        if (argc >= 2 && strcmp(argv[1], "selfplay") == 0){ // training positions from engine games, no window
+            return runSelfPlay(argc-2, argv+2);
+        }
+        if (argc >= 2 && strcmp(argv[1], "annotate") == 0){ // engine scores and move judgements for an archive's games, no window
+            return runAnnotate(argc-2, argv+2);
+        }
+    }catch (const std::exception& error){
+        std::cerr << error.what() << '\n';
+        return 1;
+    }
     if (argc < 2){ // offline ver.
         Game game;
         game.run();
@@ -0,0 +1,399 @@
+//
+//  match.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "match.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include "game_logic.hpp"
+#include "engine.hpp"
+#include "opening_book.hpp"
+
+// how one side picks its moves
+struct Player{
+    bool random; // uniformly among the legal moves, a baseline for move generator changes
+    Limits limits;
+    size_t hashMegabytes;
+};
+
+static Player parsePlayer(std::string_view text){
+    Player player{false, Limits{}, 16};
+    if (text == "random"){
+        player.random = true;
+        return player;
+    }
+    while (!text.empty()){
+        size_t end = std::min(text.find(','), text.size());
+        std::string_view option = text.substr(0, end);
+        text.remove_prefix(std::min(end+1, text.size()));
+        size_t equals = option.find('=');
+        if (equals == std::string_view::npos){
+            throw std::runtime_error("match: expected key=value in player option " + std::string(option));
+        }
+        std::string_view key = option.substr(0, equals);
+        std::string value(option.substr(equals+1));
+        if (key == "nodes"){
+            player.limits.nodes = std::strtoull(value.c_str(), nullptr, 10);
+        }else if (key == "depth"){
+            player.limits.depth = std::atoi(value.c_str());
+        }else if (key == "time"){
+            player.limits.seconds = std::atof(value.c_str());
+        }else if (key == "hash"){
+            player.hashMegabytes = std::atoi(value.c_str());
+        }else{
+            throw std::runtime_error("match: unknown player option " + std::string(key));
+        }
+    }
+    if (player.limits.nodes == 0 && player.limits.depth == 0 && player.limits.seconds <= 0){
+        throw std::runtime_error("match: a player needs a nodes, depth or time limit");
+    }
+    return player;
+}
+
+// sequential probability ratio test on the score of the first player, with a normal approximation
+// the two games of a pair share an opening so they are not independent, the pair is the sample: pentanomial on its 0, 1/2, 1, 3/2 or 2 points
+struct Sprt{
+    double elo0, elo1;
+    double alpha, beta;
+
+    static double scoreOf(double elo){
+        return 1 / (1 + std::pow(10, -elo/400));
+    }
+
+    // log likelihood ratio of elo1 against elo0 from the count of pairs by points, in half points
+    double llr(const uint64_t pairs[5]) const{
+        // half a pair of each result added so a run of only one result still has a variance
+        double total = 0, score = 0;
+        for (int points=0; points<5; ++points){
+            total += pairs[points] + 0.5;
+            score += (pairs[points] + 0.5) * points/4.0;
+        }
+        score /= total;
+        double variance = 0; // of the score per game of a pair
+        for (int points=0; points<5; ++points){
+            variance += (pairs[points] + 0.5) * (points/4.0 - score) * (points/4.0 - score);
+        }
+        variance /= total;
+        double score0 = scoreOf(elo0), score1 = scoreOf(elo1);
+        return (score1-score0) * (2*score - score0 - score1) * (total - 2.5) / (2*variance);
+    }
+
+    double lowerBound() const{
+        return std::log(beta / (1-alpha));
+    }
+
+    double upperBound() const{
+        return std::log((1-beta) / alpha);
+    }
+};
+
+static double eloOf(double score){
+    score = std::clamp(score, 1e-6, 1-1e-6);
+    return -400 * std::log10(1/score - 1);
+}
+
+struct Opening{
+    std::string fen; // empty for the standard start
+    std::vector<Move> moves; // book moves played from it
+};
+
+struct GameRecord{
+    Side winner; // meaningless for a draw
+    bool draw;
+    Termination termination;
+    std::vector<Move> moves; // including the opening
+};
+
+// first player is red in even games
+static GameRecord playGame(const Opening& opening, const Player* players[2], Engine* engines[2], std::mt19937_64& random, int maxPlies){
+    GameState state;
+    if (!opening.fen.empty()){
+        state.loadFen(opening.fen);
+    }
+    GameRecord record{Side::Red, true, Termination::MaxPlies, {}};
+    auto play = [&state, &record](Move move){
+        record.moves.push_back(move);
+        state.performMove(state.pieceAt(move.from()), toPosition(move.to())); // keeps no undo stack so games can be any length
+    };
+    for (Move move : opening.moves){
+        play(move);
+    }
+    for (Engine* engine : {engines[0], engines[1]}){
+        engine->clear(); // nothing carries over between games
+    }
+    while (!state.gameOver() && static_cast<int>(record.moves.size()) < maxPlies){
+        int side = static_cast<int>(state.currentTurn());
+        Move move;
+        if (players[side]->random){
+            MoveList moves;
+            state.generateLegalMoves(state.currentTurn(), moves);
+            move = moves[random() % moves.size()];
+        }else{
+            move = engines[side]->search(state, players[side]->limits).bestMove;
+        }
+        play(move);
+    }
+    if (state.checkmate() || state.stalemate()){
+        record.draw = false;
+        record.winner = state.checking();
+        record.termination = state.checkmate()? Termination::Checkmate : Termination::Stalemate;
+    }else if (state.ruling() == Ruling::Draw){
+        record.termination = Termination::DrawRule;
+    }else if (state.ruling() != Ruling::None){
+        record.draw = false;
+        record.winner = state.ruling() == Ruling::Win? state.currentTurn() : otherSide(state.currentTurn());
+        record.termination = Termination::Perpetual;
+    }
+    return record;
+}
+
+// appends records to the log under a lock and flushes each so the file is always whole games
+class MatchLog{
+    FILE* _file;
+    std::mutex _mutex;
+
+public:
+    MatchLog(const MatchLog&) = delete;
+
+    explicit MatchLog(const char* path) : _file(nullptr){
+        if (path == nullptr){
+            return;
+        }
+        _file = fopen(path, "wb");
+        if (_file == nullptr){
+            throw std::runtime_error(std::string("match: Could not create ") + path + ": " + strerror(errno));
+        }
+        uint32_t version = _matchLogVersion;
+        fwrite("XQML", 1, 4, _file);
+        fwrite(&version, sizeof(version), 1, _file);
+    }
+
+    ~MatchLog(){
+        if (_file != nullptr){
+            fclose(_file);
+        }
+    }
+
+    void write(uint32_t game, const Opening& opening, const GameRecord& record){
+        if (_file == nullptr){
+            return;
+        }
+        MatchRecordHeader header{game, static_cast<uint8_t>(record.draw? 1 : record.winner == Side::Red? 0:2), static_cast<uint8_t>(record.termination),
+            static_cast<uint16_t>(opening.moves.size()), static_cast<uint16_t>(record.moves.size()), static_cast<uint16_t>(opening.fen.size())};
+        std::vector<uint8_t> buffer(sizeof(header) + opening.fen.size() + record.moves.size()*sizeof(uint16_t));
+        memcpy(buffer.data(), &header, sizeof(header));
+        memcpy(buffer.data() + sizeof(header), opening.fen.data(), opening.fen.size());
+        uint8_t* moves = buffer.data() + sizeof(header) + opening.fen.size();
+        for (Move move : record.moves){
+            uint16_t raw = move.raw();
+            memcpy(moves, &raw, sizeof(raw));
+            moves += sizeof(raw);
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        fwrite(buffer.data(), 1, buffer.size(), _file);
+        fflush(_file);
+    }
+};
+
+int runMatch(int argc, const char* argv[]){
+    const char* first = nullptr;
+    const char* second = nullptr;
+    int games = 1000;
+    int concurrency = 0;
+    const char* bookPath = nullptr;
+    int bookPlies = 8;
+    const char* openingsPath = nullptr;
+    bool sprtEnabled = false;
+    Sprt sprt{0, 5, 0.05, 0.05};
+    const char* logPath = nullptr;
+    int maxPlies = 400;
+    int report = 100;
+    bool hugePages = false;
+    for (int i=0; i<argc; ++i){
+        if (strcmp(argv[i], "--first") == 0 && i+1 < argc){
+            first = argv[++i];
+        }else if (strcmp(argv[i], "--second") == 0 && i+1 < argc){
+            second = argv[++i];
+        }else if (strcmp(argv[i], "--games") == 0 && i+1 < argc){
+            games = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--concurrency") == 0 && i+1 < argc){
+            concurrency = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--book") == 0 && i+1 < argc){
+            bookPath = argv[++i];
+        }else if (strcmp(argv[i], "--book-plies") == 0 && i+1 < argc){
+            bookPlies = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--openings") == 0 && i+1 < argc){
+            openingsPath = argv[++i];
+        }else if (strcmp(argv[i], "--sprt") == 0 && i+2 < argc){
+            sprtEnabled = true;
+            sprt.elo0 = std::atof(argv[++i]);
+            sprt.elo1 = std::atof(argv[++i]);
+        }else if (strcmp(argv[i], "--alpha") == 0 && i+1 < argc){
+            sprt.alpha = std::atof(argv[++i]);
+        }else if (strcmp(argv[i], "--beta") == 0 && i+1 < argc){
+            sprt.beta = std::atof(argv[++i]);
+        }else if (strcmp(argv[i], "--log") == 0 && i+1 < argc){
+            logPath = argv[++i];
+        }else if (strcmp(argv[i], "--max-plies") == 0 && i+1 < argc){
+            maxPlies = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--report") == 0 && i+1 < argc){
+            report = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--huge-pages") == 0){
+            hugePages = true;
+        }else{
+            throw std::runtime_error(std::string("match: unknown argument ") + argv[i]);
+        }
+    }
+    if (first == nullptr || second == nullptr){
+        throw std::runtime_error("match: expected --first and --second players");
+    }
+    if (games < 2 || maxPlies < 1 || maxPlies > UINT16_MAX || report < 1){
+        throw std::runtime_error("match: games must be at least 2, max plies between 1 and 65535 and report at least 1");
+    }
+    if (sprtEnabled && (sprt.elo0 >= sprt.elo1 || sprt.alpha <= 0 || sprt.beta <= 0 || sprt.alpha + sprt.beta >= 1)){
+        throw std::runtime_error("match: SPRT needs elo0 < elo1 and alpha, beta in (0, 1)");
+    }
+    if (concurrency <= 0){
+        concurrency = std::max(1u, std::thread::hardware_concurrency());
+    }
+    Player players[2]{parsePlayer(first), parsePlayer(second)};
+    OpeningBook book;
+    if (bookPath != nullptr && !book.open(bookPath)){
+        throw std::runtime_error(std::string("match: no book at ") + bookPath);
+    }
+    std::vector<std::string> fens;
+    if (openingsPath != nullptr){
+        std::ifstream file(openingsPath);
+        if (!file){
+            throw std::runtime_error(std::string("match: Could not open ") + openingsPath);
+        }
+        GameState check;
+        for (std::string line; std::getline(file, line);){
+            if (line.empty()){
+                continue;
+            }
+            if (!check.loadFen(line)){
+                throw std::runtime_error("match: invalid FEN " + line);
+            }
+            fens.push_back(line);
+        }
+    }
+    MatchLog log(logPath);
+
+    int pairs = games/2;
+    std::atomic<int> nextPair(0);
+    std::atomic<bool> stop(false);
+    std::mutex statsMutex;
+    uint64_t results[3]{0, 0, 0}; // wins, draws, losses of the first player
+    uint64_t pairResults[5]{0, 0, 0, 0, 0}; // pairs by the first player's points in them, in half points
+    uint64_t plies = 0;
+    int played = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto printStatus = [&](){
+        uint64_t total = results[0] + results[1] + results[2];
+        double score = (results[0] + results[1]/2.0) / std::max<uint64_t>(total, 1);
+        // error of the mean over pairs, as the games of a pair are not independent
+        uint64_t pairs = 0;
+        double variance = 0;
+        for (int points=0; points<5; ++points){
+            pairs += pairResults[points];
+            variance += pairResults[points] * (points/4.0 - score) * (points/4.0 - score);
+        }
+        variance /= std::max<uint64_t>(pairs, 1);
+        double margin = 1.96 * std::sqrt(variance / std::max<uint64_t>(pairs, 1));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::fixed << std::setprecision(1) << "games " << total << "  +" << results[0] << " =" << results[1] << " -" << results[2]
+                  << "  pairs " << pairResults[0] << '/' << pairResults[1] << '/' << pairResults[2] << '/' << pairResults[3] << '/' << pairResults[4]
+                  << "  score " << 100*score << "%  elo " << eloOf(score) << " +- " << (eloOf(score + margin) - eloOf(score - margin)) / 2;
+        if (sprtEnabled){
+            std::cout << std::setprecision(2) << "  llr " << sprt.llr(pairResults)
+                      << " (" << sprt.lowerBound() << ", " << sprt.upperBound() << ")";
+        }
+        std::cout << std::setprecision(1) << "  " << total / std::max(seconds, 1e-9) << " games/s  " << plies / std::max(seconds, 1e-9) << " plies/s\n";
+    };
+
+    std::vector<std::future<void>> workers;
+    for (int thread=0; thread<concurrency; ++thread){
+        workers.push_back(std::async(std::launch::async, [&](){
+            std::unique_ptr<Engine> engines[2]{std::make_unique<Engine>(players[0].hashMegabytes, 1, hugePages),
+                std::make_unique<Engine>(players[1].hashMegabytes, 1, hugePages)};
+            for (int pair = nextPair++; pair < pairs && !stop; pair = nextPair++){
+                // both games of a pair start from the same opening, picked from the pair number so reruns are identical
+                std::mt19937_64 random(pair);
+                Opening opening{fens.empty()? std::string() : fens[pair % fens.size()], {}};
+                GameState state;
+                if (!opening.fen.empty()){
+                    state.loadFen(opening.fen);
+                }
+                for (int ply=0; ply<bookPlies && book.loaded(); ++ply){
+                    Move move = book.pickMove(state, random());
+                    if (move.isNull()){
+                        break;
+                    }
+                    opening.moves.push_back(move);
+                    state.performMove(state.pieceAt(move.from()), toPosition(move.to()));
+                }
+                int points = 0; // of the first player in this pair, in half points
+                for (int game=0; game<2; ++game){
+                    // the first player is red in the first game of the pair
+                    const Player* sides[2]{&players[game], &players[1-game]};
+                    Engine* sideEngines[2]{engines[game].get(), engines[1-game].get()};
+                    GameRecord record = playGame(opening, sides, sideEngines, random, maxPlies);
+                    log.write(2*pair + game, opening, record);
+                    std::lock_guard<std::mutex> lock(statsMutex);
+                    Side firstSide = game == 0? Side::Red : Side::Black;
+                    int result = record.draw? 1 : record.winner == firstSide? 0:2;
+                    ++results[result];
+                    points += 2 - result;
+                    plies += record.moves.size();
+                    if (game == 1){
+                        ++pairResults[points];
+                    }
+                    if (++played % report == 0){
+                        printStatus();
+                    }
+                    if (game == 1 && sprtEnabled && !stop){
+                        double llr = sprt.llr(pairResults);
+                        if (llr <= sprt.lowerBound() || llr >= sprt.upperBound()){
+                            stop = true; // pairs already running still finish and count
+                        }
+                    }
+                }
+            }
+        }));
+    }
+    for (std::future<void>& worker : workers){
+        worker.get();
+    }
+    if (played % report != 0){
+        printStatus();
+    }
+    if (sprtEnabled){
+        double llr = sprt.llr(pairResults);
+        std::cout << "SPRT [" << sprt.elo0 << ", " << sprt.elo1 << "]: "
+                  << (llr >= sprt.upperBound()? "H1 accepted" : llr <= sprt.lowerBound()? "H0 accepted" : "inconclusive") << '\n';
+    }
+    return 0;
+}
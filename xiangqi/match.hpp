@@ -0,0 +1,45 @@
+//
+//  match.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+// ./main match --first <player> --second <player> [--games <n>] [--concurrency <n>] [--book <file> [--book-plies <n>]] [--openings <fen file>]
+//              [--sprt <elo0> <elo1> [--alpha <a>] [--beta <b>]] [--log <file>] [--max-plies <n>] [--report <n>] [--huge-pages]
+// a player is "random" or limits and options separated by commas, e.g. "nodes=20000", "time=0.1,hash=32" or "depth=6"
+// games are played in pairs from the same opening with colours swapped, each game on one core with single threaded engines,
+// so --games is rounded down to an even number
+// prints wins/draws/losses of the first player with an Elo estimate and the pairs by the first player's points (0/0.5/1/1.5/2)
+// the SPRT is pentanomial over those pairs and stops the match early once it accepts either hypothesis
+int runMatch(int argc, const char* argv[]);
+
+/*
+ game log, little endian, one record appended and flushed as soon as each game finishes so a killed run keeps what it played
+ - file header: "XQML", uint32_t version
+ - per game: MatchRecordHeader, then the start FEN (empty for the standard start), then uint16_t moves[plies] as Move::raw
+ */
+struct MatchRecordHeader{
+    uint32_t game; // 2*pair for the first player as red, 2*pair+1 with colours swapped
+    uint8_t result; // 0 red won, 1 draw, 2 black won
+    uint8_t termination; // Termination
+    uint16_t openingPlies; // how many of the moves came from the book
+    uint16_t plies;
+    uint16_t fenLength;
+};
+
+static_assert(sizeof(MatchRecordHeader) == 12);
+
+constexpr static uint32_t _matchLogVersion = 1;
+
+enum class Termination : uint8_t{
+    Checkmate,
+    Stalemate,
+    Perpetual, // lost by the repetition rules
+    DrawRule, // drawn repetition or the 60 move rule
+    MaxPlies,
+};
@@ -0,0 +1,108 @@
+//
+//  move.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cassert>
+
+// from and to squares packed into 16 bits, 7 bits each
+class Move{
+    uint16_t _data;
+
+public:
+    constexpr Move() : _data(0){}
+
+    constexpr Move(int from, int to) : _data(static_cast<uint16_t>(from | to << 7)){}
+
+    constexpr static Move fromRaw(uint16_t data){
+        Move move;
+        move._data = data;
+        return move;
+    }
+
+    constexpr int from() const{
+        return _data & 0x7F;
+    }
+
+    constexpr int to() const{
+        return (_data >> 7) & 0x7F;
+    }
+
+    constexpr uint16_t raw() const{
+        return _data;
+    }
+
+    // from == to == 0 is never a real move
+    constexpr bool isNull() const{
+        return _data == 0;
+    }
+
+    constexpr bool operator==(Move other) const{
+        return _data == other._data;
+    }
+
+    constexpr bool operator!=(Move other) const{
+        return _data != other._data;
+    }
+};
+
+constexpr static Move _nullMove{};
+
+// fixed capacity so generating moves never touches the heap
+class MoveList{
+public:
+    constexpr static int _capacity = 192; // comfortably above the most legal moves any side can have
+
+private:
+    Move _moves[_capacity];
+    int _size;
+
+public:
+    MoveList() : _size(0){}
+
+    void push(Move move){
+        assert(_size < _capacity);
+        _moves[_size++] = move;
+    }
+
+    void clear(){
+        _size = 0;
+    }
+
+    int size() const{
+        return _size;
+    }
+
+    bool empty() const{
+        return _size == 0;
+    }
+
+    Move& operator[](int i){
+        return _moves[i];
+    }
+
+    Move operator[](int i) const{
+        return _moves[i];
+    }
+
+    Move* begin(){
+        return _moves;
+    }
+
+    Move* end(){
+        return _moves + _size;
+    }
+
+    const Move* begin() const{
+        return _moves;
+    }
+
+    const Move* end() const{
+        return _moves + _size;
+    }
+};
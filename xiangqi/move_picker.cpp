@@ -0,0 +1,176 @@
+//
+//  move_picker.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "move_picker.hpp"
+
+#include <algorithm>
+
+constexpr static PieceType _cheapestFirst[7]{PieceType::Bing, PieceType::Shi, PieceType::Xiang, PieceType::Ma, PieceType::Pao, PieceType::Ju, PieceType::Shuai};
+
+constexpr static int _tableMoveScore = 1 << 30;
+constexpr static int _captureScore = 1 << 28;
+constexpr static int _killerScore = 1 << 27;
+
+int staticExchange(const GameState& state, Move move){
+    int from = move.from(), to = move.to();
+    const Piece* victim = state.pieceAt(to);
+    const Piece* attacker = state.pieceAt(from);
+    int gain[32]; // gain[d]: material for the side capturing at depth d if the exchange stopped there
+    int depth = 0;
+    gain[0] = victim == nullptr? 0 : _exchangeValues[static_cast<int>(victim->type)];
+    PieceType onTarget = attacker->type;
+    Side side = attacker->side;
+    Bitboard occupied = state.occupancy() & ~squareBit(from);
+    Bitboard fileOccupied = state.fileOccupancy() & ~rotatedBit(from);
+    while (depth < 31){
+        side = otherSide(side);
+        Bitboard attackers = state.attackersTo(to, side, occupied, fileOccupied);
+        if (attackers == 0){
+            break;
+        }
+        int square = 0;
+        PieceType type = PieceType::Shuai;
+        for (PieceType cheapest : _cheapestFirst){
+            Bitboard pieces = attackers & state.occupancy(side, cheapest);
+            if (pieces != 0){
+                square = lsb(pieces);
+                type = cheapest;
+                break;
+            }
+        }
+        ++depth;
+        gain[depth] = _exchangeValues[static_cast<int>(onTarget)] - gain[depth-1];
+        if (gain[depth] <= -gain[depth-1]){ // going on can only make this capture worse, and it is already no better than stopping
+            break;
+        }
+        onTarget = type;
+        // lifting the capturer can open a ju line or give or take a pao its screen
+        occupied &= ~squareBit(square);
+        fileOccupied &= ~rotatedBit(square);
+    }
+    // each side may stop capturing whenever going on would be worse
+    for (; depth > 0; --depth){
+        gain[depth-1] = -std::max(-gain[depth-1], gain[depth]);
+    }
+    return gain[0];
+}
+
+MovePicker::MovePicker(GameState& state, bool inCheck, Move tableMove, const Move killers[2], const int history[][_squareCount]) : _state(state), _stage(inCheck? Stage::GenerateEvasions : Stage::TableMove), _capturesOnly(false), _tableMove(tableMove), _killers{killers[0], killers[1] != killers[0]? killers[1] : _nullMove}, _history(history), _index(0), _killerIndex(0), _badIndex(0){}
+
+MovePicker::MovePicker(GameState& state, bool inCheck, const int history[][_squareCount]) : _state(state), _stage(inCheck? Stage::GenerateEvasions : Stage::GenerateCaptures), _capturesOnly(true), _tableMove(_nullMove), _killers{_nullMove, _nullMove}, _history(history), _index(0), _killerIndex(0), _badIndex(0){}
+
+int MovePicker::captureScore(Move move) const{
+    return _exchangeValues[static_cast<int>(_state.pieceAt(move.to())->type)]*16 - _exchangeValues[static_cast<int>(_state.pieceAt(move.from())->type)]/16;
+}
+
+Move MovePicker::pickBest(){
+    int best = _index;
+    for (int i=_index+1; i<_moves.size(); ++i){
+        if (_scores[i] > _scores[best]){
+            best = i;
+        }
+    }
+    std::swap(_moves[_index], _moves[best]);
+    std::swap(_scores[_index], _scores[best]);
+    return _moves[_index++];
+}
+
+Move MovePicker::next(){
+    Side side = _state.currentTurn();
+    while (true){
+        switch (_stage){
+            case (Stage::TableMove):
+                _stage = Stage::GenerateCaptures;
+                if (!_tableMove.isNull() && _state.isLegal(_tableMove)){
+                    return _tableMove;
+                }
+                break;
+            case (Stage::GenerateCaptures):
+                _state.generateCaptures(side, _moves);
+                for (int i=0; i<_moves.size(); ++i){
+                    _scores[i] = captureScore(_moves[i]);
+                }
+                _index = 0;
+                _stage = Stage::GoodCaptures;
+                break;
+            case (Stage::GoodCaptures):
+                while (_index < _moves.size()){
+                    Move move = pickBest();
+                    if (move == _tableMove){
+                        continue;
+                    }
+                    if (staticExchange(_state, move) < 0){ // losing captures wait until after the quiet moves
+                        if (!_capturesOnly){
+                            _badCaptures.push(move);
+                        }
+                        continue;
+                    }
+                    return move;
+                }
+                _stage = _capturesOnly? Stage::Done : Stage::Killers;
+                break;
+            case (Stage::Killers):
+                while (_killerIndex < 2){
+                    Move killer = _killers[_killerIndex++];
+                    if (!killer.isNull() && killer != _tableMove && _state.pieceAt(killer.to()) == nullptr && _state.isLegal(killer)){
+                        return killer;
+                    }
+                }
+                _stage = Stage::GenerateQuiets;
+                break;
+            case (Stage::GenerateQuiets):
+                _moves.clear();
+                _state.generateQuiets(side, _moves);
+                for (int i=0; i<_moves.size(); ++i){
+                    _scores[i] = _history[_moves[i].from()][_moves[i].to()];
+                }
+                _index = 0;
+                _stage = Stage::Quiets;
+                break;
+            case (Stage::Quiets):
+                while (_index < _moves.size()){
+                    Move move = pickBest();
+                    if (move != _tableMove && move != _killers[0] && move != _killers[1]){
+                        return move;
+                    }
+                }
+                _stage = Stage::BadCaptures;
+                break;
+            case (Stage::BadCaptures):
+                if (_badIndex < _badCaptures.size()){
+                    return _badCaptures[_badIndex++];
+                }
+                _stage = Stage::Done;
+                break;
+            case (Stage::GenerateEvasions):
+                _state.generateEvasions(side, _moves);
+                for (int i=0; i<_moves.size(); ++i){
+                    Move move = _moves[i];
+                    if (move == _tableMove){
+                        _scores[i] = _tableMoveScore;
+                    }else if (_state.pieceAt(move.to()) != nullptr){
+                        _scores[i] = _captureScore + captureScore(move);
+                    }else if (move == _killers[0] || move == _killers[1]){
+                        _scores[i] = _killerScore;
+                    }else{
+                        _scores[i] = _history[move.from()][move.to()];
+                    }
+                }
+                _index = 0;
+                _stage = Stage::Evasions;
+                break;
+            case (Stage::Evasions):
+                if (_index < _moves.size()){
+                    return pickBest();
+                }
+                _stage = Stage::Done;
+                break;
+            case (Stage::Done):
+                return _nullMove;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+//
+//  move_picker.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include "game_logic.hpp"
+
+// piece values for ordering and exchanges only, the shuai is priced so that no exchange ever gives it up
+constexpr static int _exchangeValues[7]{10000, 200, 200, 400, 900, 450, 100}; // indexed by PieceType
+
+// material the side making move ends up with if both sides keep recapturing on its target with their cheapest piece
+// attackers are recomputed after every capture so pao screens and blocked ma legs that come and go are accounted for
+int staticExchange(const GameState& state, Move move);
+
+/*
+ hands out legal moves one at a time in the order a search wants to try them
+ - hash move, checked for legality, before anything is generated
+ - captures by most valuable victim then least valuable attacker, those losing material by staticExchange held back
+ - killer moves, then quiet moves by history, then the held back captures
+ - when in check, every evasion in one list ordered the same way
+ each stage is generated only when reached and picked by selection, so a cutoff on the first move never pays for the rest
+ */
+class MovePicker{
+    enum class Stage{
+        TableMove,
+        GenerateCaptures,
+        GoodCaptures,
+        Killers,
+        GenerateQuiets,
+        Quiets,
+        BadCaptures,
+        GenerateEvasions,
+        Evasions,
+        Done,
+    };
+    
+    GameState& _state;
+    Stage _stage;
+    bool _capturesOnly;
+    Move _tableMove;
+    Move _killers[2];
+    const int (*_history)[_squareCount];
+    MoveList _moves, _badCaptures;
+    int _scores[MoveList::_capacity];
+    int _index, _killerIndex, _badIndex;
+    
+    int captureScore(Move move) const;
+    
+    // moves the best remaining move to _index and returns it
+    Move pickBest();
+    
+public:
+    // every legal move of the side to move, history is indexed [from][to]
+    MovePicker(GameState& state, bool inCheck, Move tableMove, const Move killers[2], const int history[][_squareCount]);
+    
+    // for quiescence: captures that do not lose material, or every evasion when in check
+    MovePicker(GameState& state, bool inCheck, const int history[][_squareCount]);
+    
+    // _nullMove once there are no moves left
+    Move next();
+};
@@ -0,0 +1,255 @@
+//
+//  move_tables.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "bitboard.hpp"
+
+// side index is 0 for red, 1 for black (same order as Side)
+constexpr bool inPalace(int side, int x, int y){
+    return x >= 3 && x <= 5 && (side == 0? y >= 7 && y <= 9:y >= 0 && y <= 2);
+}
+
+// xiang and unpromoted bing stay on their own side of the river
+constexpr bool ownSide(int side, int y){
+    return side == 0? y > 4:y < 5;
+}
+
+constexpr static uint8_t _noBlock = 0xFF;
+
+// destinations of a stepping piece from one square, already clipped to the board/palace/river
+struct StepMoves{
+    uint8_t count;
+    uint8_t to[8];
+    uint8_t block[8]; // square that has to be empty for to[i] (horse leg, elephant eye), _noBlock if none
+    Bitboard targets; // all of to[]
+
+    constexpr void add(int square, int blockSquare = _noBlock){
+        to[count] = square;
+        block[count] = blockSquare;
+        targets |= squareBit(square);
+        ++count;
+    }
+};
+
+using StepTable = std::array<StepMoves, _squareCount>;
+
+inline Bitboard stepTargets(const StepMoves& steps, Bitboard occupied){
+    Bitboard targets = _emptyBitboard;
+    for (int i=0; i<steps.count; ++i){
+        if (steps.block[i] == _noBlock || !testBit(occupied, steps.block[i])){
+            targets |= squareBit(steps.to[i]);
+        }
+    }
+    return targets;
+}
+
+constexpr StepTable makeMaTable(){
+    // {ma offset, horse leg offset}
+    constexpr int steps[8][4]{
+        {2, 1, 1, 0}, {2, -1, 1, 0}, {-2, 1, -1, 0}, {-2, -1, -1, 0},
+        {1, 2, 0, 1}, {-1, 2, 0, 1}, {1, -2, 0, -1}, {-1, -2, 0, -1},
+    };
+    StepTable table{};
+    for (int square=0; square<_squareCount; ++square){
+        int x = fileOf(square), y = rankOf(square);
+        for (const auto& step : steps){
+            if (onBoard(x+step[0], y+step[1])){
+                table[square].add(squareOf(x+step[0], y+step[1]), squareOf(x+step[2], y+step[3]));
+            }
+        }
+    }
+    return table;
+}
+
+// squares a ma can attack the given square from, block is the leg (diagonally adjacent to the target)
+constexpr StepTable makeMaAttackerTable(){
+    constexpr int steps[8][4]{
+        {2, 1, 1, 1}, {2, -1, 1, -1}, {-2, 1, -1, 1}, {-2, -1, -1, -1},
+        {1, 2, 1, 1}, {-1, 2, -1, 1}, {1, -2, 1, -1}, {-1, -2, -1, -1},
+    };
+    StepTable table{};
+    for (int square=0; square<_squareCount; ++square){
+        int x = fileOf(square), y = rankOf(square);
+        for (const auto& step : steps){
+            if (onBoard(x+step[0], y+step[1])){
+                table[square].add(squareOf(x+step[0], y+step[1]), squareOf(x+step[2], y+step[3]));
+            }
+        }
+    }
+    return table;
+}
+
+constexpr StepTable makeXiangTable(int side){
+    StepTable table{};
+    for (int square=0; square<_squareCount; ++square){
+        int x = fileOf(square), y = rankOf(square);
+        if (!ownSide(side, y)){
+            continue;
+        }
+        for (int dx : {-1, 1}){
+            for (int dy : {-1, 1}){
+                if (onBoard(x+dx*2, y+dy*2) && ownSide(side, y+dy*2)){
+                    table[square].add(squareOf(x+dx*2, y+dy*2), squareOf(x+dx, y+dy));
+                }
+            }
+        }
+    }
+    return table;
+}
+
+constexpr StepTable makeShiTable(int side){
+    StepTable table{};
+    for (int square=0; square<_squareCount; ++square){
+        int x = fileOf(square), y = rankOf(square);
+        if (!inPalace(side, x, y)){
+            continue;
+        }
+        for (int dx : {-1, 1}){
+            for (int dy : {-1, 1}){
+                if (inPalace(side, x+dx, y+dy)){
+                    table[square].add(squareOf(x+dx, y+dy));
+                }
+            }
+        }
+    }
+    return table;
+}
+
+constexpr StepTable makeShuaiTable(int side){
+    constexpr int steps[4][2]{{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    StepTable table{};
+    for (int square=0; square<_squareCount; ++square){
+        int x = fileOf(square), y = rankOf(square);
+        if (!inPalace(side, x, y)){
+            continue;
+        }
+        for (const auto& step : steps){
+            if (inPalace(side, x+step[0], y+step[1])){
+                table[square].add(squareOf(x+step[0], y+step[1]));
+            }
+        }
+    }
+    return table;
+}
+
+constexpr StepTable makeBingTable(int side){
+    int forward = side == 0? -1:1;
+    StepTable table{};
+    for (int square=0; square<_squareCount; ++square){
+        int x = fileOf(square), y = rankOf(square);
+        if (onBoard(x, y+forward)){
+            table[square].add(squareOf(x, y+forward));
+        }
+        // crossed the river?
+        if (!ownSide(side, y)){
+            if (x > 0){
+                table[square].add(squareOf(x-1, y));
+            }
+            if (x < _boardFiles-1){
+                table[square].add(squareOf(x+1, y));
+            }
+        }
+    }
+    return table;
+}
+
+// squares a bing of side can attack the given square from
+constexpr StepTable makeBingAttackerTable(int side){
+    int forward = side == 0? -1:1;
+    StepTable table{};
+    for (int square=0; square<_squareCount; ++square){
+        int x = fileOf(square), y = rankOf(square);
+        if (onBoard(x, y-forward)){
+            table[square].add(squareOf(x, y-forward));
+        }
+        if (!ownSide(side, y)){
+            if (x > 0){
+                table[square].add(squareOf(x-1, y));
+            }
+            if (x < _boardFiles-1){
+                table[square].add(squareOf(x+1, y));
+            }
+        }
+    }
+    return table;
+}
+
+// xiang, shi and shuai moves are symmetric so their tables double as attacker tables
+inline constexpr StepTable _maMoves = makeMaTable();
+inline constexpr StepTable _maAttackers = makeMaAttackerTable();
+inline constexpr StepTable _xiangMoves[2]{makeXiangTable(0), makeXiangTable(1)};
+inline constexpr StepTable _shiMoves[2]{makeShiTable(0), makeShiTable(1)};
+inline constexpr StepTable _shuaiMoves[2]{makeShuaiTable(0), makeShuaiTable(1)};
+inline constexpr StepTable _bingMoves[2]{makeBingTable(0), makeBingTable(1)};
+inline constexpr StepTable _bingAttackers[2]{makeBingAttackerTable(0), makeBingAttackerTable(1)};
+
+// sliding attacks along one line, indexed by the square's place on the line and that line's occupancy
+struct SliderTables{
+    constexpr static int _ju = 0;
+    constexpr static int _pao = 1;
+    
+    // ju: empty squares plus the first piece in each direction, pao: the first piece after the screen
+    uint16_t rank[2][_boardFiles][1 << _boardFiles]; // [ju/pao][x][rank occupancy] -> attacked files
+    uint16_t file[2][_boardRanks][1 << _boardRanks]; // [ju/pao][y][file occupancy] -> attacked ranks
+    Bitboard fileSpread[1 << _boardRanks]; // mask of ranks -> those squares on file 0
+};
+
+constexpr uint16_t lineAttacks(int index, int length, unsigned occupied, bool pao){
+    uint16_t attacks = 0;
+    for (int dir : {-1, 1}){
+        bool screen = false;
+        for (int i=index+dir; i >= 0 && i < length; i+=dir){
+            bool blocked = (occupied >> i) & 1;
+            if (!screen){
+                if (!pao || !blocked){
+                    attacks |= 1 << i;
+                }
+                if (blocked){
+                    if (!pao){
+                        break;
+                    }
+                    screen = true;
+                }
+            }else if (blocked){
+                attacks |= 1 << i;
+                break;
+            }
+        }
+    }
+    return attacks;
+}
+
+// pao attacks only contain the square it can capture, its quiet moves are the ju attacks that are empty
+inline SliderTables makeSliderTables(){
+    SliderTables tables{};
+    for (int piece : {SliderTables::_ju, SliderTables::_pao}){
+        for (int x=0; x<_boardFiles; ++x){
+            for (unsigned occupied=0; occupied < (1u << _boardFiles); ++occupied){
+                tables.rank[piece][x][occupied] = lineAttacks(x, _boardFiles, occupied, piece == SliderTables::_pao);
+            }
+        }
+        for (int y=0; y<_boardRanks; ++y){
+            for (unsigned occupied=0; occupied < (1u << _boardRanks); ++occupied){
+                tables.file[piece][y][occupied] = lineAttacks(y, _boardRanks, occupied, piece == SliderTables::_pao);
+            }
+        }
+    }
+    for (unsigned ranks=0; ranks < (1u << _boardRanks); ++ranks){
+        for (int y=0; y<_boardRanks; ++y){
+            if ((ranks >> y) & 1){
+                tables.fileSpread[ranks] |= squareBit(squareOf(0, y));
+            }
+        }
+    }
+    return tables;
+}
+
+inline const SliderTables _sliderTables = makeSliderTables();
@@ -0,0 +1,163 @@
+//
+//  nnue.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "nnue.hpp"
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+constexpr static int _hiddenShift = 6; // layer 2 weights are scaled by 64
+constexpr static int _clipMax = 127;
+
+constexpr static size_t _networkBytes = sizeof(NetworkHeader) +
+    sizeof(int16_t)*_nnueHidden + sizeof(int16_t)*_nnueFeatures*_nnueHidden +
+    sizeof(int32_t)*_nnueHidden2 + sizeof(int8_t)*_nnueHidden2*2*_nnueHidden +
+    sizeof(int32_t) + sizeof(int8_t)*_nnueHidden2;
+
+static_assert(sizeof(NetworkHeader) == 32);
+static_assert(_nnueHidden % 32 == 0 && _nnueHidden2 % 8 == 0, "sizes must fill whole AVX2 registers");
+
+bool loadNetwork(const char* path){
+    int fd = open(path, O_RDONLY);
+    if (fd == -1){
+        if (errno == ENOENT){
+            return false;
+        }
+        throw std::runtime_error(std::string("loadNetwork: Could not open ") + path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) != _networkBytes){
+        close(fd);
+        throw std::runtime_error(std::string("loadNetwork: ") + path + " does not have the size of a network");
+    }
+    void* memory = mmap(nullptr, _networkBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (memory == MAP_FAILED){
+        throw std::runtime_error(std::string("loadNetwork: Could not map ") + path + ": " + strerror(errno));
+    }
+    madvise(memory, _networkBytes, MADV_WILLNEED); // feature columns are read in no particular order
+    const NetworkHeader* header = static_cast<const NetworkHeader*>(memory);
+    if (memcmp(header->magic, "XQNN", 4) != 0 || header->version != _networkVersion ||
+        header->features != _nnueFeatures || header->hidden != _nnueHidden || header->hidden2 != _nnueHidden2 || header->outputDivisor <= 0){
+        munmap(memory, _networkBytes);
+        throw std::runtime_error(std::string("loadNetwork: ") + path + " is not a network of this version and shape");
+    }
+
+    static Network network;
+    const char* data = static_cast<const char*>(memory) + sizeof(NetworkHeader);
+    network.featureBiases = reinterpret_cast<const int16_t*>(data);
+    data += sizeof(int16_t)*_nnueHidden;
+    network.featureWeights = reinterpret_cast<const int16_t*>(data);
+    data += sizeof(int16_t)*_nnueFeatures*_nnueHidden;
+    network.hiddenBiases = reinterpret_cast<const int32_t*>(data);
+    data += sizeof(int32_t)*_nnueHidden2;
+    network.hiddenWeights = reinterpret_cast<const int8_t*>(data);
+    data += sizeof(int8_t)*_nnueHidden2*2*_nnueHidden;
+    memcpy(&network.outputBias, data, sizeof(int32_t));
+    data += sizeof(int32_t);
+    network.outputWeights = reinterpret_cast<const int8_t*>(data);
+    network.outputDivisor = header->outputDivisor;
+    _network = &network;
+    return true;
+}
+
+void resetAccumulator(int16_t accumulator[_nnueHidden]){
+    memcpy(accumulator, _network->featureBiases, sizeof(int16_t)*_nnueHidden);
+}
+
+// int16 sums wrap the same way on both paths so subtracting a feature always undoes adding it
+void addFeature(int16_t accumulator[_nnueHidden], int feature){
+    const int16_t* column = _network->featureWeights + static_cast<size_t>(feature)*_nnueHidden;
+#ifdef __AVX2__
+    for (int i=0; i<_nnueHidden; i+=16){
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accumulator + i), sum);
+    }
+#else
+    for (int i=0; i<_nnueHidden; ++i){
+        accumulator[i] = static_cast<int16_t>(accumulator[i] + column[i]);
+    }
+#endif
+}
+
+void subtractFeature(int16_t accumulator[_nnueHidden], int feature){
+    const int16_t* column = _network->featureWeights + static_cast<size_t>(feature)*_nnueHidden;
+#ifdef __AVX2__
+    for (int i=0; i<_nnueHidden; i+=16){
+        __m256i difference = _mm256_sub_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accumulator + i), difference);
+    }
+#else
+    for (int i=0; i<_nnueHidden; ++i){
+        accumulator[i] = static_cast<int16_t>(accumulator[i] - column[i]);
+    }
+#endif
+}
+
+// clips an accumulator into [0, 127] bytes
+static void clip(const int16_t* accumulator, uint8_t* out){
+#ifdef __AVX2__
+    const __m256i zero = _mm256_setzero_si256(), max = _mm256_set1_epi16(_clipMax);
+    for (int i=0; i<_nnueHidden; i+=32){
+        __m256i low = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i)), zero), max);
+        __m256i high = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i + 16)), zero), max);
+        // packing works per 128-bit lane, the permute puts the bytes back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0b11011000);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+#else
+    for (int i=0; i<_nnueHidden; ++i){
+        out[i] = static_cast<uint8_t>(std::clamp<int>(accumulator[i], 0, _clipMax));
+    }
+#endif
+}
+
+// unsigned inputs times signed weights, neither sum of a pair can saturate since both are at most 127
+static int32_t dot(const uint8_t* input, const int8_t* weights, int size){
+#ifdef __AVX2__
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i=0; i<size; i+=32){
+        __m256i pairs = _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pairs, ones));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b01001110));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b10110001));
+    return _mm_cvtsi128_si32(half);
+#else
+    int32_t sum = 0;
+    for (int i=0; i<size; ++i){
+        sum += input[i] * weights[i];
+    }
+    return sum;
+#endif
+}
+
+int evaluateNetwork(const int16_t us[_nnueHidden], const int16_t them[_nnueHidden]){
+    alignas(32) uint8_t input[2*_nnueHidden];
+    clip(us, input);
+    clip(them, input + _nnueHidden);
+    int32_t output = _network->outputBias;
+    for (int i=0; i<_nnueHidden2; ++i){
+        int32_t hidden = _network->hiddenBiases[i] + dot(input, _network->hiddenWeights + i*2*_nnueHidden, 2*_nnueHidden);
+        output += std::clamp(hidden >> _hiddenShift, 0, _clipMax) * _network->outputWeights[i];
+    }
+    return output / _network->outputDivisor;
+}
@@ -0,0 +1,80 @@
+//
+//  nnue.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "bitboard.hpp"
+
+/*
+ efficiently updatable neural network evaluation
+ - input: for each perspective, one feature per piece other than its own shuai, (shuai bucket, piece kind, square)
+   squares are seen from the perspective's side of the board, the bucket is which of the 9 palace squares its shuai is on
+   piece kinds are 7 own types then 7 enemy types
+ - layer 1: sparse features -> _nnueHidden int16 per perspective, kept incrementally by GameState as the accumulator
+ - layer 2: both accumulators (side to move first) clipped to [0, 127] -> _nnueHidden2 int8 weights, clipped to [0, 127]
+ - output: _nnueHidden2 -> 1, divided by the file's outputDivisor to get centipawns for the side to move
+ */
+constexpr static int _nnueBuckets = 9;
+constexpr static int _nnuePieceKinds = 14;
+constexpr static int _nnueFeatures = _nnueBuckets*_nnuePieceKinds*_squareCount;
+constexpr static int _nnueHidden = 256;
+constexpr static int _nnueHidden2 = 32;
+
+// file layout, little endian, every array follows the previous one with no padding
+struct NetworkHeader{
+    char magic[4]; // "XQNN"
+    uint32_t version; // _networkVersion
+    uint32_t features, hidden, hidden2; // must match the constants above
+    int32_t outputDivisor;
+    uint32_t reserved[2];
+    // int16_t featureBiases[hidden]
+    // int16_t featureWeights[features][hidden]
+    // int32_t hiddenBiases[hidden2]
+    // int8_t hiddenWeights[hidden2][2*hidden]
+    // int32_t outputBias
+    // int8_t outputWeights[hidden2]
+};
+
+constexpr static uint32_t _networkVersion = 1;
+
+// views into the mapped file
+struct Network{
+    const int16_t* featureBiases;
+    const int16_t* featureWeights;
+    const int32_t* hiddenBiases;
+    const int8_t* hiddenWeights;
+    int32_t outputBias;
+    const int8_t* outputWeights;
+    int32_t outputDivisor;
+};
+
+// set by loadNetwork, nullptr until then
+inline const Network* _network = nullptr;
+
+// maps the weights read only for the rest of the program, to be called at startup before any GameState is set up
+// returns false if there is no file at path, throws if the file is not a valid network
+bool loadNetwork(const char* path);
+
+constexpr int nnueFeature(int perspective, int shuaiSquare, int side, int type, int square){
+    // red sees the board as it is, black upside down so its own palace is always at the bottom
+    int orientedShuai = perspective == 0? shuaiSquare : squareOf(fileOf(shuaiSquare), _boardRanks-1 - rankOf(shuaiSquare));
+    int orientedSquare = perspective == 0? square : squareOf(fileOf(square), _boardRanks-1 - rankOf(square));
+    int bucket = (rankOf(orientedShuai) - 7)*3 + fileOf(orientedShuai) - 3;
+    int kind = (side == perspective? 0:7) + type;
+    return (bucket*_nnuePieceKinds + kind)*_squareCount + orientedSquare;
+}
+
+void resetAccumulator(int16_t accumulator[_nnueHidden]);
+
+void addFeature(int16_t accumulator[_nnueHidden], int feature);
+
+void subtractFeature(int16_t accumulator[_nnueHidden], int feature);
+
+// centipawns for the side whose accumulator is us
+int evaluateNetwork(const int16_t us[_nnueHidden], const int16_t them[_nnueHidden]);
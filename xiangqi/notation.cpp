@@ -0,0 +1,168 @@
+//
+//  notation.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "notation.hpp"
+
+#include <utility>
+#include <cstdlib>
+
+bool parseIccs(std::string_view text, Move& move){
+    if (text.size() != _iccsLength || text[0] < 'a' || text[0] > 'i' || text[2] < 'a' || text[2] > 'i' ||
+        text[1] < '0' || text[1] > '9' || text[3] < '0' || text[3] > '9'){
+        return false;
+    }
+    move = Move(squareOf(text[0]-'a', _boardRanks-1 - (text[1]-'0')), squareOf(text[2]-'a', _boardRanks-1 - (text[3]-'0')));
+    return true;
+}
+
+void writeIccs(Move move, char* out){
+    out[0] = static_cast<char>('a' + fileOf(move.from()));
+    out[1] = static_cast<char>('0' + _boardRanks-1 - rankOf(move.from()));
+    out[2] = static_cast<char>('a' + fileOf(move.to()));
+    out[3] = static_cast<char>('0' + _boardRanks-1 - rankOf(move.to()));
+}
+
+// wxf files run 1-9 from each side's right hand
+static int wxfFile(int x, Side side){
+    return side == Side::Red? _boardFiles - x : x + 1;
+}
+
+static int fileX(int file, Side side){
+    return side == Side::Red? _boardFiles - file : file - 1;
+}
+
+static int forwardOf(Side side){
+    return side == Side::Red? -1 : 1;
+}
+
+static bool wxfPieceType(char c, PieceType& type){
+    switch (c | 0x20){ // lowercase
+        case 'k': type = PieceType::Shuai; return true;
+        case 'a': type = PieceType::Shi; return true;
+        case 'e': case 'b': type = PieceType::Xiang; return true;
+        case 'h': case 'n': type = PieceType::Ma; return true;
+        case 'r': type = PieceType::Ju; return true;
+        case 'c': type = PieceType::Pao; return true;
+        case 'p': type = PieceType::Bing; return true;
+        default: return false;
+    }
+}
+
+// moves along files and ranks, so a move forward or backward is written as a rank count
+static bool orthogonal(PieceType type){
+    return type == PieceType::Shuai || type == PieceType::Ju || type == PieceType::Pao || type == PieceType::Bing;
+}
+
+// how the pieces of one kind share files, for front and rear signs
+struct FileCounts{
+    int counts[_boardFiles]{};
+    int crowded = 0; // files with two or more
+
+    FileCounts(const GameState& state, Side side, PieceType type){
+        Bitboard pieces = state.occupancy(side, type);
+        while (pieces != 0){
+            if (++counts[fileOf(popLsb(pieces))] == 2){
+                ++crowded;
+            }
+        }
+    }
+
+    // signs are only used for exactly two pieces of a kind that can be on one file, and for bing only if no other file has two
+    bool tandem(int x, PieceType type) const{
+        return counts[x] == 2 && type != PieceType::Shuai && type != PieceType::Shi && type != PieceType::Xiang &&
+            (type != PieceType::Bing || crowded == 1);
+    }
+};
+
+// the other piece of the kind on the file is behind it
+static bool inFront(const GameState& state, int square){
+    const Piece* piece = state.pieceAt(square);
+    Bitboard others = state.occupancy(piece->side, piece->type);
+    while (others != 0){
+        int other = popLsb(others);
+        if (other != square && fileOf(other) == fileOf(square) && (rankOf(other) - rankOf(square)) * forwardOf(piece->side) > 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseWxf(std::string_view text, const GameState& state, Move& move){
+    if (text.size() != _wxfLength){
+        return false;
+    }
+    char letter = text[0], file = text[1], direction = text[2], number = text[3];
+    if (letter == '+' || letter == '-'){ // "+R.4" as well as "R+.4"
+        std::swap(letter, file);
+    }
+    PieceType type;
+    if (!wxfPieceType(letter, type) || number < '1' || number > '9'){
+        return false;
+    }
+    if (direction == '='){
+        direction = '.';
+    }
+    if (direction != '+' && direction != '-' && direction != '.'){
+        return false;
+    }
+    Side side = state.currentTurn();
+    int step = direction == '+'? forwardOf(side) : -forwardOf(side);
+    FileCounts files(state, side, type);
+    bool found = false;
+    Bitboard pieces = state.occupancy(side, type);
+    while (pieces != 0){
+        int from = popLsb(pieces);
+        int x = fileOf(from), y = rankOf(from);
+        if (file == '+' || file == '-'){
+            if (!files.tandem(x, type) || inFront(state, from) != (file == '+')){
+                continue;
+            }
+        }else if (file < '1' || file > '9' || fileX(file-'0', side) != x){
+            continue;
+        }
+        int toX, toY;
+        if (orthogonal(type)){
+            toX = direction == '.'? fileX(number-'0', side) : x;
+            toY = direction == '.'? y : y + step*(number-'0');
+        }else{
+            if (direction == '.'){
+                continue;
+            }
+            toX = fileX(number-'0', side);
+            int dx = std::abs(toX - x);
+            int dy = type == PieceType::Shi? 1 : type == PieceType::Xiang? 2 : dx == 1? 2 : dx == 2? 1 : 0;
+            toY = y + step*dy;
+            if (dy == 0){
+                continue;
+            }
+        }
+        if (!onBoard(toX, toY) || !state.isLegal(Move(from, squareOf(toX, toY)))){
+            continue;
+        }
+        if (found){ // two pieces fit
+            return false;
+        }
+        move = Move(from, squareOf(toX, toY));
+        found = true;
+    }
+    return found;
+}
+
+void writeWxf(const GameState& state, Move move, char* out){
+    constexpr static char letters[] = "KAEHRCP"; // by PieceType
+    const Piece* piece = state.pieceAt(move.from());
+    int x = fileOf(move.from());
+    int dy = (rankOf(move.to()) - rankOf(move.from())) * forwardOf(piece->side);
+    out[0] = letters[static_cast<int>(piece->type)];
+    if (FileCounts(state, piece->side, piece->type).tandem(x, piece->type)){
+        out[1] = inFront(state, move.from())? '+':'-';
+    }else{
+        out[1] = static_cast<char>('0' + wxfFile(x, piece->side));
+    }
+    out[2] = dy > 0? '+' : dy < 0? '-' : '.';
+    out[3] = static_cast<char>('0' + (orthogonal(piece->type) && dy != 0? std::abs(dy) : wxfFile(fileOf(move.to()), piece->side)));
+}
@@ -0,0 +1,38 @@
+//
+//  notation.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <string_view>
+
+#include "game_logic.hpp"
+
+// none of these allocate, so they can be run over every move of a game archive
+
+// "h2e2": files a-i from left to right and ranks 0-9 from red's side, as in UCCI
+// only checks the syntax, whether the move is legal is up to the caller
+bool parseIccs(std::string_view text, Move& move);
+
+constexpr static int _iccsLength = 4;
+
+// writes _iccsLength characters without a terminating null
+void writeIccs(Move move, char* out);
+
+/*
+ WXF, e.g. "C2.5", "H8+7", "R+.4", read from the side to move's own view
+ - piece letter: K A E H R C P, B and N are also read for the xiang and ma, either case, and a front/rear sign may come before it
+ - file 1-9 counted from the side's right, or + / - for the front or rear of two ju, ma, pao or bing on one file
+ - + forward, - backward, . (or =) along the rank
+ - ranks moved for shuai, ju, pao and bing going forward or backward, otherwise the file moved to
+ */
+bool parseWxf(std::string_view text, const GameState& state, Move& move);
+
+constexpr static int _wxfLength = 4;
+
+// move must be legal for the side to move, writes _wxfLength characters without a terminating null
+// three or more bing on one file, or two pairs of them on different files, are written with their file and may not read back
+void writeWxf(const GameState& state, Move move, char* out);
@@ -0,0 +1,112 @@
+//
+//  opening_book.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "opening_book.hpp"
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+OpeningBook::OpeningBook() : _entries(nullptr), _size(0){}
+
+OpeningBook::~OpeningBook(){
+    close();
+}
+
+void OpeningBook::close(){
+    if (_entries != nullptr){
+        munmap(const_cast<BookEntry*>(_entries), _size*sizeof(BookEntry));
+    }
+    _entries = nullptr;
+    _size = 0;
+}
+
+bool OpeningBook::open(const char* path){
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1){
+        if (errno == ENOENT){
+            return false;
+        }
+        throw std::runtime_error(std::string("OpeningBook::open: Could not open ") + path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size % sizeof(BookEntry) != 0){
+        ::close(fd);
+        throw std::runtime_error(std::string("OpeningBook::open: ") + path + " is not a whole number of book entries");
+    }
+    close();
+    if (info.st_size == 0){ // nothing to map, every lookup misses
+        ::close(fd);
+        return true;
+    }
+    void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid
+    if (memory == MAP_FAILED){
+        throw std::runtime_error(std::string("OpeningBook::open: Could not map ") + path + ": " + strerror(errno));
+    }
+    madvise(memory, info.st_size, MADV_RANDOM); // a game only touches a few pages of a big book
+    _entries = static_cast<const BookEntry*>(memory);
+    _size = info.st_size / sizeof(BookEntry);
+    return true;
+}
+
+bool OpeningBook::loaded() const{
+    return _entries != nullptr;
+}
+
+size_t OpeningBook::find(uint64_t key) const{
+    size_t low = 0, high = _size;
+    while (low < high){
+        size_t middle = low + (high-low)/2;
+        if (_entries[middle].key < key){
+            low = middle+1;
+        }else{
+            high = middle;
+        }
+    }
+    return low < _size && _entries[low].key == key? low : _size;
+}
+
+Move OpeningBook::bestMove(const GameState& state) const{
+    uint64_t key = state.hash();
+    // entries of a position are already ordered by weight
+    for (size_t i=find(key); i<_size && _entries[i].key == key; ++i){
+        Move move = Move::fromRaw(_entries[i].move);
+        if (_entries[i].weight > 0 && state.isLegal(move)){
+            return move;
+        }
+    }
+    return _nullMove;
+}
+
+Move OpeningBook::pickMove(const GameState& state, uint64_t random) const{
+    uint64_t key = state.hash();
+    size_t first = find(key);
+    uint64_t total = 0;
+    for (size_t i=first; i<_size && _entries[i].key == key; ++i){
+        total += _entries[i].weight;
+    }
+    if (total == 0){
+        return _nullMove;
+    }
+    uint64_t target = random % total;
+    for (size_t i=first; i<_size && _entries[i].key == key; ++i){
+        if (target < _entries[i].weight){
+            Move move = Move::fromRaw(_entries[i].move);
+            // a hash collision or a bad book could name a move that cannot be played here
+            return state.isLegal(move)? move : bestMove(state);
+        }
+        target -= _entries[i].weight;
+    }
+    return _nullMove;
+}
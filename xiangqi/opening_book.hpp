@@ -0,0 +1,58 @@
+//
+//  opening_book.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "game_logic.hpp"
+#include "move.hpp"
+
+/*
+ opening book in the style of polyglot
+ - the file is nothing but 16-byte entries, little endian, sorted by key and then by weight from high to low
+ - key is GameState::hash of the position, so the side to move is part of it
+ - a position has one entry per book move, weight is how often it should be played relative to the others
+ */
+struct BookEntry{
+    uint64_t key;
+    uint16_t move; // Move::raw
+    uint16_t weight;
+    uint32_t learn; // unused, kept for the layout
+};
+
+static_assert(sizeof(BookEntry) == 16);
+
+class OpeningBook{
+    const BookEntry* _entries; // mapped read only, nullptr if no book is open
+    size_t _size;
+
+    void close();
+
+    // index of the first entry with key, _size if there is none
+    size_t find(uint64_t key) const;
+
+public:
+    OpeningBook(const OpeningBook&) = delete;
+
+    OpeningBook();
+
+    ~OpeningBook();
+
+    // maps the file, nothing is read until a position is looked up
+    // returns false if there is no file at path, throws if the file is not a book
+    bool open(const char* path);
+
+    bool loaded() const;
+
+    // book move with the highest weight that is legal in state, _nullMove if the position is not in the book
+    Move bestMove(const GameState& state) const;
+
+    // book move chosen with probability proportional to its weight, random is any uniformly distributed number
+    Move pickMove(const GameState& state, uint64_t random) const;
+};
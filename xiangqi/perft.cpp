@@ -0,0 +1,107 @@
+//
+//  perft.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "perft.hpp"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+
+#include "notation.hpp"
+
+uint64_t perft(GameState& state, int depth){
+    if (depth == 0){
+        return 1;
+    }
+    MoveList moves;
+    state.generateLegalMoves(state.currentTurn(), moves);
+    if (depth == 1){ // bulk count the last ply
+        return moves.size();
+    }
+    uint64_t nodes = 0;
+    for (Move move : moves){
+        state.makeMove(move);
+        nodes += perft(state, depth-1);
+        state.unmakeMove();
+    }
+    return nodes;
+}
+
+int runPerft(int argc, const char* argv[]){
+    if (argc < 1){
+        throw std::runtime_error("Usage: perft <depth> [--fen \"<fen>\"] [--divide] [--threads <n>]");
+    }
+    int depth = std::atoi(argv[0]);
+    const char* fen = nullptr;
+    bool divide = false;
+    unsigned threads = 1;
+    for (int i=1; i<argc; ++i){
+        if (strcmp(argv[i], "--fen") == 0 && i+1 < argc){
+            fen = argv[++i];
+        }else if (strcmp(argv[i], "--divide") == 0){
+            divide = true;
+        }else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+            threads = std::atoi(argv[++i]);
+        }else{
+            throw std::runtime_error(std::string("perft: unknown argument ") + argv[i]);
+        }
+    }
+    if (depth < 1){
+        throw std::runtime_error("perft: depth must be at least 1");
+    }
+    if (threads == 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    GameState root;
+    if (fen != nullptr && !root.loadFen(fen)){
+        throw std::runtime_error("perft: invalid FEN");
+    }
+
+    MoveList rootMoves;
+    root.generateLegalMoves(root.currentTurn(), rootMoves);
+    std::vector<uint64_t> rootNodes(rootMoves.size(), 0);
+    auto start = std::chrono::steady_clock::now();
+    // each worker takes the next unsearched root move on its own copy of the position
+    std::atomic<int> next = 0;
+    auto worker = [&](){
+        GameState state = root;
+        for (int i = next++; i < rootMoves.size(); i = next++){
+            state.makeMove(rootMoves[i]);
+            rootNodes[i] = perft(state, depth-1);
+            state.unmakeMove();
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (unsigned i=1; i<threads; ++i){
+        workers.push_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (std::future<void>& future : workers){
+        future.get();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t nodes = 0;
+    for (int i=0; i<rootMoves.size(); ++i){
+        if (divide){
+            char iccs[_iccsLength];
+            writeIccs(rootMoves[i], iccs);
+            std::cout << std::string_view(iccs, _iccsLength) << ": " << rootNodes[i] << '\n';
+        }
+        nodes += rootNodes[i];
+    }
+    std::cout << "perft " << depth << ": " << nodes << " nodes in " << seconds << "s (" << static_cast<uint64_t>(nodes / std::max(seconds, 1e-9)) << " nps, " << threads << " threads)\n";
+    return 0;
+}
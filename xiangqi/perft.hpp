@@ -0,0 +1,18 @@
+//
+//  perft.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "game_logic.hpp"
+
+// number of leaf nodes of the legal move tree to depth
+uint64_t perft(GameState& state, int depth);
+
+// ./main perft <depth> [--fen "<fen>"] [--divide] [--threads <n>, 0 for all cores]
+int runPerft(int argc, const char* argv[]);
@@ -0,0 +1,217 @@
+//
+//  piece_square_tables.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "bitboard.hpp"
+
+// material plus a bonus for where the piece stands, one table for the middlegame and one for the endgame
+// values are signed from red's point of view so a position's score is just the sum over its pieces
+struct PieceSquareTables{
+    int16_t midgame[2][7][_squareCount]; // [side][piece type][square]
+    int16_t endgame[2][7][_squareCount];
+};
+
+// how much each piece counts towards the middlegame, the total of the starting position is _maxPhase
+constexpr static int _phaseWeights[7]{0, 0, 0, 1, 2, 1, 0}; // indexed by PieceType
+constexpr static int _maxPhase = 16;
+
+constexpr static int _midgameMaterial[7]{0, 120, 120, 390, 900, 450, 70};
+constexpr static int _endgameMaterial[7]{0, 130, 130, 420, 950, 400, 110};
+
+// bonuses for red, y = 0 is black's back rank, black uses the same tables flipped
+constexpr static int8_t _midgameBonus[7][_squareCount]{
+    { // shuai, stepping out of the back rank is dangerous while there are attackers
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0, -30, -30, -30,   0,   0,   0,
+        0,   0,   0, -12, -10, -12,   0,   0,   0,
+        0,   0,   0,  -2,   8,  -2,   0,   0,   0,
+    },
+    { // shi
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,  -2,   0,  -2,   0,   0,   0,
+        0,   0,   0,   0,   6,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+    },
+    { // xiang
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,  -2,   0,   0,   0,  -2,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+       -4,   0,   0,   0,   6,   0,   0,   0,  -4,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+    },
+    { // ma
+        4,   8,  16,  12,   4,  12,  16,   8,   4,
+        4,  10,  28,  16,   8,  16,  28,  10,   4,
+       12,  14,  16,  20,  18,  20,  16,  14,  12,
+        8,  24,  18,  24,  20,  24,  18,  24,   8,
+        6,  16,  14,  18,  16,  18,  14,  16,   6,
+        4,  12,  16,  14,  12,  14,  16,  12,   4,
+        2,   6,   8,   6,  10,   6,   8,   6,   2,
+        4,   2,   8,   8,   4,   8,   8,   2,   4,
+        0,   2,   4,   4,  -2,   4,   4,   2,   0,
+        0,  -4,   0,   0,   0,   0,   0,  -4,   0,
+    },
+    { // ju
+       14,  14,  12,  18,  16,  18,  12,  14,  14,
+       16,  20,  18,  24,  26,  24,  18,  20,  16,
+       12,  12,  12,  18,  18,  18,  12,  12,  12,
+       12,  18,  16,  22,  22,  22,  16,  18,  12,
+       12,  14,  12,  18,  18,  18,  12,  14,  12,
+       12,  16,  14,  20,  20,  20,  14,  16,  12,
+        6,  10,   8,  14,  14,  14,   8,  10,   6,
+        4,   8,   6,  14,  12,  14,   6,   8,   4,
+        8,   4,   8,  16,   8,  16,   8,   4,   8,
+       -2,  10,   6,  14,  12,  14,   6,  10,  -2,
+    },
+    { // pao, central file and the enemy back ranks
+        6,   4,   0, -10, -12, -10,   0,   4,   6,
+        2,   2,   0,  -4, -14,  -4,   0,   2,   2,
+        2,   2,   0, -10,  -8, -10,   0,   2,   2,
+        0,   0,  -2,   4,  10,   4,  -2,   0,   0,
+        0,   0,   0,   2,   8,   2,   0,   0,   0,
+       -2,   0,   4,   2,   6,   2,   4,   0,  -2,
+        0,   0,   0,   2,   4,   2,   0,   0,   0,
+        4,   0,   8,   6,  10,   6,   8,   0,   4,
+        0,   2,   4,   6,   6,   6,   4,   2,   0,
+        0,   0,   2,   6,   6,   6,   2,   0,   0,
+    },
+    { // bing, worth more once across the river and near the palace
+        0,   3,   6,   9,  12,   9,   6,   3,   0,
+       18,  36,  56,  80, 120,  80,  56,  36,  18,
+       14,  26,  42,  60,  80,  60,  42,  26,  14,
+       10,  20,  30,  34,  40,  34,  30,  20,  10,
+        6,  12,  18,  18,  20,  18,  18,  12,   6,
+        2,   0,   8,   0,   8,   0,   8,   0,   2,
+        0,   0,  -2,   0,   4,   0,  -2,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+    },
+};
+
+constexpr static int8_t _endgameBonus[7][_squareCount]{
+    { // shuai, a little activity helps once the board empties
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,  -8,  -4,  -8,   0,   0,   0,
+        0,   0,   0,   0,   4,   0,   0,   0,   0,
+        0,   0,   0,   0,   2,   0,   0,   0,   0,
+    },
+    { // shi
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   4,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+    },
+    { // xiang
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   4,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+    },
+    { // ma, centralised
+        0,   4,   8,   8,   8,   8,   8,   4,   0,
+        4,  10,  16,  16,  16,  16,  16,  10,   4,
+        8,  16,  20,  22,  22,  22,  20,  16,   8,
+        8,  16,  22,  24,  24,  24,  22,  16,   8,
+        6,  14,  20,  22,  22,  22,  20,  14,   6,
+        6,  14,  20,  22,  22,  22,  20,  14,   6,
+        4,  10,  16,  18,  18,  18,  16,  10,   4,
+        2,   6,  10,  12,  12,  12,  10,   6,   2,
+        0,   4,   6,   8,   8,   8,   6,   4,   0,
+       -4,   0,   2,   2,   2,   2,   2,   0,  -4,
+    },
+    { // ju
+       10,  10,  10,  14,  14,  14,  10,  10,  10,
+       12,  14,  14,  18,  18,  18,  14,  14,  12,
+       10,  12,  12,  14,  14,  14,  12,  12,  10,
+       10,  12,  12,  14,  14,  14,  12,  12,  10,
+        8,  10,  10,  12,  12,  12,  10,  10,   8,
+        8,  10,  10,  12,  12,  12,  10,  10,   8,
+        6,   8,   8,  10,  10,  10,   8,   8,   6,
+        6,   8,   8,  10,  10,  10,   8,   8,   6,
+        4,   6,   6,   8,   8,   8,   6,   6,   4,
+        4,   6,   6,   8,   8,   8,   6,   6,   4,
+    },
+    { // pao, needs screens so it prefers its own half late in the game
+        0,   0,   0,   2,   4,   2,   0,   0,   0,
+        0,   0,   0,   2,   4,   2,   0,   0,   0,
+        0,   0,   0,   2,   4,   2,   0,   0,   0,
+        0,   0,   0,   2,   4,   2,   0,   0,   0,
+        0,   0,   0,   2,   4,   2,   0,   0,   0,
+        0,   0,   0,   2,   4,   2,   0,   0,   0,
+        0,   0,   0,   4,   6,   4,   0,   0,   0,
+        0,   0,   0,   4,   8,   4,   0,   0,   0,
+        0,   0,   0,   6,   8,   6,   0,   0,   0,
+        0,   0,   0,   6,   8,   6,   0,   0,   0,
+    },
+    { // bing, close to the enemy palace but not past it
+       10,  20,  30,  40,  40,  40,  30,  20,  10,
+       40,  60,  80, 100, 110, 100,  80,  60,  40,
+       40,  60,  76,  90, 100,  90,  76,  60,  40,
+       36,  50,  60,  70,  74,  70,  60,  50,  36,
+       30,  40,  46,  50,  54,  50,  46,  40,  30,
+        0,   0,   6,   0,   8,   0,   6,   0,   0,
+        0,   0,   0,   0,   4,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+        0,   0,   0,   0,   0,   0,   0,   0,   0,
+    },
+};
+
+constexpr PieceSquareTables makePieceSquareTables(){
+    PieceSquareTables tables{};
+    for (int type=0; type<7; ++type){
+        for (int square=0; square<_squareCount; ++square){
+            int mirrored = squareOf(fileOf(square), _boardRanks-1 - rankOf(square)); // black sees the board upside down
+            tables.midgame[0][type][square] = _midgameMaterial[type] + _midgameBonus[type][square];
+            tables.endgame[0][type][square] = _endgameMaterial[type] + _endgameBonus[type][square];
+            tables.midgame[1][type][square] = -(_midgameMaterial[type] + _midgameBonus[type][mirrored]);
+            tables.endgame[1][type][square] = -(_endgameMaterial[type] + _endgameBonus[type][mirrored]);
+        }
+    }
+    return tables;
+}
+
+inline constexpr PieceSquareTables _pieceSquare = makePieceSquareTables();
@@ -0,0 +1,554 @@
+//
+//  position_index.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "position_index.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "game_archive.hpp"
+#include "notation.hpp"
+
+PositionIndex::PositionIndex() : _data(nullptr), _size(0), _header{}{}
+
+PositionIndex::~PositionIndex(){
+    close();
+}
+
+void PositionIndex::close(){
+    if (_data != nullptr){
+        munmap(const_cast<uint8_t*>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+    _header = PositionIndexHeader{};
+}
+
+bool PositionIndex::open(const char* path){
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1){
+        if (errno == ENOENT){
+            return false;
+        }
+        throw std::runtime_error(std::string("PositionIndex::open: Could not open ") + path + ": " + strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < sizeof(PositionIndexHeader)){
+        ::close(fd);
+        throw std::runtime_error(std::string("PositionIndex::open: ") + path + " is too short to be an index");
+    }
+    close();
+    void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid
+    if (memory == MAP_FAILED){
+        throw std::runtime_error(std::string("PositionIndex::open: Could not map ") + path + ": " + strerror(errno));
+    }
+    madvise(memory, info.st_size, MADV_RANDOM); // a lookup touches a few pages of the positions and one run of postings
+    _data = static_cast<const uint8_t*>(memory);
+    _size = info.st_size;
+    memcpy(&_header, _data, sizeof(_header));
+    if (memcmp(_header.magic, "XQPI", 4) != 0 || _header.version != _positionIndexVersion ||
+        _header.postingsOffset + _header.postingCount*sizeof(IndexPosting) > _header.movesOffset ||
+        _header.movesOffset + _header.moveCount*sizeof(IndexedMove) > _header.positionsOffset ||
+        _header.positionsOffset + _header.positionCount*sizeof(IndexedPosition) != _size){
+        close();
+        throw std::runtime_error(std::string("PositionIndex::open: ") + path + " is not a version " + std::to_string(_positionIndexVersion) + " index");
+    }
+    return true;
+}
+
+bool PositionIndex::loaded() const{
+    return _data != nullptr;
+}
+
+uint64_t PositionIndex::gameCount() const{
+    return _header.gameCount;
+}
+
+const IndexedPosition* PositionIndex::find(const GameState& state) const{
+    if (_data == nullptr){
+        return nullptr;
+    }
+    const IndexedPosition* positions = reinterpret_cast<const IndexedPosition*>(_data + _header.positionsOffset);
+    uint64_t key = state.hash();
+    const IndexedPosition* found = std::lower_bound(positions, positions + _header.positionCount, key, [](const IndexedPosition& position, uint64_t key){
+        return position.key < key;
+    });
+    return found != positions + _header.positionCount && found->key == key? found : nullptr;
+}
+
+const IndexedMove* PositionIndex::moves(const IndexedPosition& position) const{
+    return reinterpret_cast<const IndexedMove*>(_data + _header.movesOffset) + position.firstMove;
+}
+
+const IndexPosting* PositionIndex::postings(const IndexedPosition& position) const{
+    return reinterpret_cast<const IndexPosting*>(_data + _header.postingsOffset) + position.firstPosting;
+}
+
+constexpr static size_t _maxMergeWays = 128; // runs merged at once, each reading its own block
+constexpr static size_t _mergeBufferSize = 4096; // entries written at a time by a merge pass
+
+// a posting with the key it sorts by, as written to the temporary runs
+struct RunPosting{
+    uint64_t key;
+    IndexPosting posting;
+};
+
+static bool operator<(const RunPosting& a, const RunPosting& b){
+    if (a.key != b.key){
+        return a.key < b.key;
+    }
+    return a.posting.game != b.posting.game? a.posting.game < b.posting.game : a.posting.ply < b.posting.ply;
+}
+
+// sorted runs back to back in one temporary file, so there can be any number of them without running out of open files
+class RunFile{
+    FILE* _file;
+    uint64_t _size; // entries
+    std::mutex _mutex;
+
+public:
+    RunFile(const RunFile&) = delete;
+
+    RunFile() : _file(std::tmpfile()), _size(0){
+        if (_file == nullptr){
+            throw std::runtime_error(std::string("index: Could not create a temporary file: ") + strerror(errno));
+        }
+    }
+
+    ~RunFile(){
+        fclose(_file); // tmpfile removes itself
+    }
+
+    // thread safe, returns the number of the first entry written
+    uint64_t append(const RunPosting* entries, size_t count){
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (fwrite(entries, sizeof(RunPosting), count, _file) != count){
+            throw std::runtime_error(std::string("index: Could not write a temporary run: ") + strerror(errno));
+        }
+        _size += count;
+        return _size - count;
+    }
+
+    uint64_t size() const{
+        return _size;
+    }
+
+    // called once everything is appended, before any run is read
+    int finish(){
+        if (fflush(_file) != 0){
+            throw std::runtime_error(std::string("index: Could not write a temporary run: ") + strerror(errno));
+        }
+        return fileno(_file);
+    }
+};
+
+struct RunSpan{
+    uint64_t first; // entry in its RunFile
+    uint64_t count;
+};
+
+// a run read back a block at a time during a merge
+class Run{
+    constexpr static size_t _blockSize = 4096;
+
+    int _fd;
+    uint64_t _next, _end; // entries in the file
+    std::vector<RunPosting> _block;
+    size_t _read;
+
+public:
+    Run(int fd, RunSpan span) : _fd(fd), _next(span.first), _end(span.first + span.count), _read(0){}
+
+    bool read(RunPosting& entry){
+        if (_read == _block.size()){
+            size_t count = static_cast<size_t>(std::min<uint64_t>(_blockSize, _end - _next));
+            if (count == 0){
+                return false;
+            }
+            _block.resize(count);
+            size_t bytes = count*sizeof(RunPosting);
+            off_t offset = static_cast<off_t>(_next*sizeof(RunPosting));
+            for (size_t done = 0; done < bytes;){
+                ssize_t got = pread(_fd, reinterpret_cast<char*>(_block.data()) + done, bytes - done, offset + done);
+                if (got <= 0){
+                    throw std::runtime_error(std::string("index: Could not read a temporary run: ") + strerror(errno));
+                }
+                done += got;
+            }
+            _next += count;
+            _read = 0;
+        }
+        entry = _block[_read++];
+        return true;
+    }
+};
+
+// calls visit(entry) for the entries of runs [first, last) in sorted order
+template<typename Visit>
+static void mergeRuns(int fd, const std::vector<RunSpan>& spans, size_t first, size_t last, Visit&& visit){
+    std::vector<Run> runs;
+    for (size_t i=first; i<last; ++i){
+        runs.emplace_back(fd, spans[i]);
+    }
+    using Head = std::pair<RunPosting, size_t>; // next entry of a run and which run
+    auto later = [](const Head& a, const Head& b){
+        return b.first < a.first;
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+    for (size_t i=0; i<runs.size(); ++i){
+        RunPosting entry;
+        if (runs[i].read(entry)){
+            heads.emplace(entry, i);
+        }
+    }
+    while (!heads.empty()){
+        auto [entry, run] = heads.top();
+        heads.pop();
+        RunPosting next;
+        if (runs[run].read(next)){
+            heads.emplace(next, run);
+        }
+        visit(entry);
+    }
+}
+
+static void writeAll(FILE* file, const void* data, size_t size){
+    if (size > 0 && fwrite(data, 1, size, file) != size){
+        throw std::runtime_error(std::string("index: Could not write: ") + strerror(errno));
+    }
+}
+
+// appends a temporary section to the index
+static void copySection(FILE* from, FILE* to){
+    rewind(from);
+    std::vector<char> buffer(1 << 20);
+    for (size_t read; (read = fread(buffer.data(), 1, buffer.size(), from)) > 0;){
+        writeAll(to, buffer.data(), read);
+    }
+    fclose(from);
+}
+
+// turns the merged postings into position entries and moves, one key at a time
+// postings go straight into the index as they come, only the counts of the key being merged are kept
+class PositionWriter{
+    const std::vector<uint8_t>& _results; // ArchiveResult by game
+    FILE* _out;
+    FILE* _moves;
+    FILE* _positions;
+    IndexedPosition _position; // of the key being merged, no postings if there is none
+    uint32_t _lastGame;
+    std::vector<IndexedMove> _moveStats; // of the key being merged, no more than its legal moves
+
+public:
+    uint64_t positionCount = 0, moveCount = 0, postingCount = 0;
+
+    PositionWriter(const std::vector<uint8_t>& results, FILE* out) : _results(results), _out(out), _moves(std::tmpfile()), _positions(std::tmpfile()), _position{}, _lastGame(0){
+        if (_moves == nullptr || _positions == nullptr){
+            throw std::runtime_error(std::string("index: Could not create a temporary file: ") + strerror(errno));
+        }
+    }
+
+    void add(const RunPosting& entry){
+        if (_position.postingCount > 0 && _position.key != entry.key){
+            flush();
+        }
+        if (_position.postingCount == std::numeric_limits<uint32_t>::max()){
+            throw std::runtime_error("index: too many postings of one position for 32 bit counts, index fewer plies");
+        }
+        const IndexPosting& posting = entry.posting;
+        if (_position.postingCount == 0){
+            _position = IndexedPosition{entry.key, postingCount, 0, 0, {0, 0, 0}, 0, 0};
+        }
+        writeAll(_out, &posting, sizeof(posting)); // buffered by the FILE
+        uint8_t result = _results[posting.game];
+        // postings are sorted by game, so a game coming back to the position is counted once
+        bool newGame = _position.postingCount == 0 || _lastGame != posting.game;
+        _lastGame = posting.game;
+        ++_position.postingCount;
+        ++postingCount;
+        if (newGame && result < 3){
+            ++_position.results[result];
+        }
+        if (posting.move == 0){
+            return;
+        }
+        auto stats = std::find_if(_moveStats.begin(), _moveStats.end(), [&posting](const IndexedMove& move){
+            return move.move == posting.move;
+        });
+        if (stats == _moveStats.end()){
+            _moveStats.push_back(IndexedMove{posting.move, 0, 0, {0, 0, 0}});
+            stats = _moveStats.end()-1;
+        }
+        ++stats->count;
+        if (result < 3){
+            ++stats->results[result];
+        }
+    }
+
+    void flush(){
+        if (_position.postingCount == 0){
+            return;
+        }
+        if (moveCount + _moveStats.size() > std::numeric_limits<uint32_t>::max()){
+            throw std::runtime_error("index: too many moves for 32 bit offsets, index fewer plies");
+        }
+        std::sort(_moveStats.begin(), _moveStats.end(), [](const IndexedMove& a, const IndexedMove& b){
+            return a.count != b.count? a.count > b.count : a.move < b.move;
+        });
+        _position.firstMove = static_cast<uint32_t>(moveCount);
+        _position.moveCount = static_cast<uint16_t>(_moveStats.size());
+        writeAll(_moves, _moveStats.data(), _moveStats.size()*sizeof(IndexedMove));
+        writeAll(_positions, &_position, sizeof(_position));
+        ++positionCount;
+        moveCount += _moveStats.size();
+        _moveStats.clear();
+        _position.postingCount = 0;
+    }
+
+    // appends the moves and positions after the postings and fills in where they start
+    void finish(PositionIndexHeader& header){
+        flush();
+        header.postingCount = postingCount;
+        header.movesOffset = header.postingsOffset + postingCount*sizeof(IndexPosting);
+        copySection(_moves, _out);
+        size_t padding = (8 - moveCount*sizeof(IndexedMove) % 8) % 8;
+        writeAll(_out, "\0\0\0\0\0\0\0", padding);
+        header.moveCount = moveCount;
+        header.positionsOffset = header.movesOffset + moveCount*sizeof(IndexedMove) + padding;
+        copySection(_positions, _out);
+        header.positionCount = positionCount;
+    }
+};
+
+static int buildIndex(const char* archivePath, const char* indexPath, int maxPlies, int threads, size_t memoryMegabytes){
+    auto start = std::chrono::steady_clock::now();
+    GameArchive archive;
+    archive.open(archivePath);
+    if (archive.gameCount() > std::numeric_limits<uint32_t>::max()){
+        throw std::runtime_error("index: more games than 32 bit game numbers");
+    }
+    if (threads <= 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // pass 1: replay the games, each thread sorting its own runs
+    std::vector<uint8_t> results(archive.gameCount());
+    auto runFile = std::make_unique<RunFile>();
+    std::vector<RunSpan> spans;
+    std::mutex runMutex;
+    std::atomic<uint32_t> nextBlock(0);
+    std::atomic<uint64_t> failed(0);
+    size_t runCapacity = std::max<size_t>(1, memoryMegabytes*1024*1024 / sizeof(RunPosting) / threads);
+    std::vector<std::future<void>> workers;
+    for (int thread=0; thread<threads; ++thread){
+        workers.push_back(std::async(std::launch::async, [&](){
+            std::vector<RunPosting> entries;
+            entries.reserve(runCapacity);
+            auto writeRun = [&](){
+                std::sort(entries.begin(), entries.end());
+                RunSpan span{runFile->append(entries.data(), entries.size()), entries.size()};
+                entries.clear();
+                std::lock_guard<std::mutex> lock(runMutex);
+                spans.push_back(span);
+            };
+            auto push = [&](const RunPosting& entry){
+                entries.push_back(entry);
+                if (entries.size() == runCapacity){
+                    writeRun();
+                }
+            };
+            GameState state;
+            for (uint32_t block = nextBlock++; block < archive.blockCount(); block = nextBlock++){
+                uint32_t gameNumber = static_cast<uint32_t>(archive.block(block).firstGame);
+                GameArchive::Cursor cursor = archive.games(block, block+1);
+                for (ArchiveGame game; cursor.next(game); ++gameNumber){
+                    results[gameNumber] = static_cast<uint8_t>(game.result);
+                    int ply = 0;
+                    bool replayed = replayGame(game, state, true, [&](const GameState& state, Move move){
+                        if (maxPlies == 0 || ply < maxPlies){
+                            push(RunPosting{state.hash(), IndexPosting{gameNumber, static_cast<uint16_t>(ply), move.raw()}});
+                        }
+                        ++ply;
+                    });
+                    if (!replayed){ // whatever was indexed before the bad move stays
+                        ++failed;
+                    }else if ((maxPlies == 0 && ply <= UINT16_MAX) || ply < maxPlies){ // where the game ended
+                        push(RunPosting{state.hash(), IndexPosting{gameNumber, static_cast<uint16_t>(ply), 0}});
+                    }
+                }
+            }
+            if (!entries.empty()){
+                writeRun();
+            }
+        }));
+    }
+    for (std::future<void>& worker : workers){
+        worker.get();
+    }
+    double replaySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // merge passes until few enough runs are left to merge them all at once, each pass merging groups of that many into one
+    size_t runCount = spans.size();
+    int mergePasses = 0;
+    while (spans.size() > _maxMergeWays){
+        auto merged = std::make_unique<RunFile>();
+        std::vector<RunSpan> mergedSpans;
+        std::vector<RunPosting> buffer;
+        int fd = runFile->finish();
+        for (size_t first=0; first<spans.size(); first+=_maxMergeWays){
+            uint64_t start = merged->size();
+            mergeRuns(fd, spans, first, std::min(first + _maxMergeWays, spans.size()), [&](const RunPosting& entry){
+                buffer.push_back(entry);
+                if (buffer.size() == _mergeBufferSize){
+                    merged->append(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            });
+            merged->append(buffer.data(), buffer.size());
+            buffer.clear();
+            mergedSpans.push_back(RunSpan{start, merged->size() - start});
+        }
+        runFile = std::move(merged); // the runs it merged are deleted with it
+        spans = std::move(mergedSpans);
+        ++mergePasses;
+    }
+
+    // last pass: merge the runs into the index
+    FILE* out = fopen(indexPath, "wb");
+    if (out == nullptr){
+        throw std::runtime_error(std::string("index: Could not create ") + indexPath + ": " + strerror(errno));
+    }
+    PositionIndexHeader header{{'X', 'Q', 'P', 'I'}, _positionIndexVersion, archive.gameCount(), 0, 0, 0, 0, 0, sizeof(PositionIndexHeader)};
+    writeAll(out, &header, sizeof(header)); // filled in at the end
+    PositionWriter writer(results, out);
+    mergeRuns(runFile->finish(), spans, 0, spans.size(), [&writer](const RunPosting& entry){
+        writer.add(entry);
+    });
+    runFile.reset();
+    writer.finish(header);
+    bool written = fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    if (fclose(out) != 0 || !written){
+        throw std::runtime_error(std::string("index: Could not write the index: ") + strerror(errno));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(1) << archive.gameCount() << " games, " << writer.positionCount << " positions, "
+              << writer.postingCount << " postings from " << runCount << " sorted runs and " << mergePasses << " extra merge passes in " << seconds << " s ("
+              << replaySeconds << " s replaying, " << archive.gameCount() / std::max(replaySeconds, 1e-9) << " games/s)";
+    if (failed > 0){
+        std::cout << ", " << failed << " games cut short at an illegal move";
+    }
+    std::cout << '\n';
+    return 0;
+}
+
+static int queryIndex(int argc, const char* argv[]){
+    PositionIndex index;
+    if (!index.open(argv[0])){
+        throw std::runtime_error(std::string("index: no index at ") + argv[0]);
+    }
+    GameState state;
+    int shownMoves = 10;
+    for (int i=1; i<argc; ++i){
+        if (strcmp(argv[i], "--fen") == 0 && i+1 < argc){
+            if (!state.loadFen(argv[++i])){
+                throw std::runtime_error(std::string("index: invalid FEN ") + argv[i]);
+            }
+        }else if (strcmp(argv[i], "--moves") == 0){
+            for (; i+1 < argc && argv[i+1][0] != '-'; ++i){
+                Move move;
+                if (!parseIccs(argv[i+1], move) || !state.isLegal(move)){
+                    throw std::runtime_error(std::string("index: not a legal move ") + argv[i+1]);
+                }
+                state.performMove(move);
+            }
+        }else if (strcmp(argv[i], "--top") == 0 && i+1 < argc){
+            shownMoves = std::atoi(argv[++i]);
+        }else{
+            throw std::runtime_error(std::string("index: unknown argument ") + argv[i]);
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    const IndexedPosition* position = index.find(state);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << state.fen() << '\n';
+    if (position == nullptr){
+        std::cout << "no games, looked up in " << std::fixed << std::setprecision(3) << seconds*1000 << " ms\n";
+        return 1;
+    }
+    auto percentages = [](const uint32_t* results){
+        double total = std::max(1u, results[0] + results[1] + results[2]);
+        std::cout << std::fixed << std::setprecision(1) << "red " << 100*results[0]/total << "% draw "
+                  << 100*results[1]/total << "% black " << 100*results[2]/total << '%';
+    };
+    std::cout << position->postingCount << " postings, ";
+    percentages(position->results);
+    std::cout << ", looked up in " << std::setprecision(3) << seconds*1000 << " ms\n";
+    const IndexedMove* moves = index.moves(*position);
+    for (int i=0; i<std::min<int>(shownMoves, position->moveCount); ++i){
+        char iccs[_iccsLength], wxf[_wxfLength];
+        writeIccs(Move::fromRaw(moves[i].move), iccs);
+        writeWxf(state, Move::fromRaw(moves[i].move), wxf);
+        std::cout << std::string_view(iccs, _iccsLength) << ' ' << std::string_view(wxf, _wxfLength) << std::setw(10) << moves[i].count << "  ";
+        percentages(moves[i].results);
+        std::cout << '\n';
+    }
+    const IndexPosting* postings = index.postings(*position);
+    std::cout << "games";
+    for (uint32_t i=0; i<std::min<uint32_t>(position->postingCount, 10); ++i){
+        std::cout << ' ' << postings[i].game << '@' << postings[i].ply;
+    }
+    std::cout << (position->postingCount > 10? " ...\n" : "\n");
+    return 0;
+}
+
+int runPositionIndex(int argc, const char* argv[]){
+    if (argc >= 3 && strcmp(argv[0], "build") == 0){
+        int maxPlies = 60, threads = 0;
+        size_t memoryMegabytes = 1024;
+        for (int i=3; i<argc; ++i){
+            if (strcmp(argv[i], "--plies") == 0 && i+1 < argc){
+                maxPlies = std::atoi(argv[++i]);
+            }else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+                threads = std::atoi(argv[++i]);
+            }else if (strcmp(argv[i], "--memory") == 0 && i+1 < argc){
+                memoryMegabytes = std::strtoull(argv[++i], nullptr, 10);
+            }else{
+                throw std::runtime_error(std::string("index: unknown argument ") + argv[i]);
+            }
+        }
+        if (maxPlies < 0 || maxPlies > UINT16_MAX || memoryMegabytes == 0){
+            throw std::runtime_error("index: plies must be between 0 and 65535 and memory at least 1 mb");
+        }
+        return buildIndex(argv[1], argv[2], maxPlies, threads, memoryMegabytes);
+    }
+    if (argc >= 2 && strcmp(argv[0], "query") == 0){
+        return queryIndex(argc-1, argv+1);
+    }
+    throw std::runtime_error("index: expected build <archive> <index> or query <index>");
+}
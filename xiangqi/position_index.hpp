@@ -0,0 +1,106 @@
+//
+//  position_index.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "game_logic.hpp"
+#include "move.hpp"
+
+// ./main index build <archive> <index> [--plies <n>, 0 for all] [--threads <n>, 0 for all cores] [--memory <mb>]
+// replays the archive's games across threads, every position in the first n plies (60 by default) becomes a posting
+// postings are sorted in runs of at most mb megabytes in a temporary file and merged, so the archive can be bigger than memory,
+// more than 128 runs take extra merge passes
+// ./main index query <index> [--fen "<fen>"] [--moves <ICCS moves...>] [--top <n>]
+// prints how many games reached the position, their results and the n moves played from it most often
+int runPositionIndex(int argc, const char* argv[]);
+
+/*
+ position index, little endian, each section 8 byte aligned
+ - PositionIndexHeader
+ - IndexPosting[postingCount], grouped by position in key order and by game within a position
+ - IndexedMove[moveCount], grouped by position, most played first
+ - IndexedPosition[positionCount], sorted by key, looked up with a binary search
+ */
+struct PositionIndexHeader{
+    char magic[4]; // "XQPI"
+    uint32_t version; // _positionIndexVersion
+    uint64_t gameCount;
+    uint64_t positionCount;
+    uint64_t moveCount;
+    uint64_t postingCount;
+    uint64_t positionsOffset;
+    uint64_t movesOffset;
+    uint64_t postingsOffset;
+};
+
+static_assert(sizeof(PositionIndexHeader) == 64);
+
+// results are counted once per game, however often it came back to the position, games with no known result are left out
+struct IndexedPosition{
+    uint64_t key; // GameState::hash
+    uint64_t firstPosting;
+    uint32_t postingCount;
+    uint32_t firstMove;
+    uint32_t results[3]; // red won, draw, black won
+    uint16_t moveCount;
+    uint16_t reserved;
+};
+
+static_assert(sizeof(IndexedPosition) == 40);
+
+struct IndexedMove{
+    uint16_t move; // Move::raw
+    uint16_t reserved;
+    uint32_t count; // times played
+    uint32_t results[3]; // of the games it was played in, as for IndexedPosition
+};
+
+static_assert(sizeof(IndexedMove) == 20);
+
+struct IndexPosting{
+    uint32_t game; // number in the archive
+    uint16_t ply;
+    uint16_t move; // Move::raw played from the position, 0 if the game ended there
+};
+
+static_assert(sizeof(IndexPosting) == 8);
+
+constexpr static uint32_t _positionIndexVersion = 1;
+
+class PositionIndex{
+    const uint8_t* _data; // mapped read only, nullptr if no index is open
+    size_t _size;
+    PositionIndexHeader _header;
+
+    void close();
+
+public:
+    PositionIndex(const PositionIndex&) = delete;
+
+    PositionIndex();
+
+    ~PositionIndex();
+
+    // maps the file, nothing is read until a position is looked up
+    // returns false if there is no file at path, throws if the file is not an index
+    bool open(const char* path);
+
+    bool loaded() const;
+
+    uint64_t gameCount() const;
+
+    // nullptr if no game in the index reached the position
+    const IndexedPosition* find(const GameState& state) const;
+
+    // of a position found with find
+    const IndexedMove* moves(const IndexedPosition& position) const;
+
+    const IndexPosting* postings(const IndexedPosition& position) const;
+};
@@ -0,0 +1,302 @@
+//
+//  selfplay.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "selfplay.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include "engine.hpp"
+
+constexpr static int _scoreLimit = 2000; // positions already this lopsided teach nothing
+constexpr static int _adjudicateScore = 1500; // a game is given to the side this far ahead
+constexpr static int _adjudicatePlies = 8; // for this many plies in a row
+constexpr static int _reportSeconds = 10;
+
+PackedPosition packPosition(const GameState& state, int score){
+    PackedPosition packed{};
+    int count = 0;
+    for (int square=0; square<_squareCount; ++square){
+        const Piece* piece = state.pieceAt(square);
+        if (piece == nullptr){
+            continue;
+        }
+        packed.occupancy[square/8] |= 1 << square%8;
+        int nibble = static_cast<int>(piece->side)*7 + static_cast<int>(piece->type);
+        packed.pieces[count/2] |= nibble << (count%2 * 4);
+        ++count;
+    }
+    packed.score = static_cast<int16_t>(std::clamp(score, -Engine::_mateScore, Engine::_mateScore));
+    packed.turn = static_cast<uint8_t>(state.currentTurn());
+    return packed;
+}
+
+bool unpackPosition(const PackedPosition& packed, GameState& state){
+    Piece pieces[32];
+    int count = 0;
+    for (int square=0; square<_squareCount; ++square){
+        if ((packed.occupancy[square/8] >> square%8 & 1) == 0){
+            continue;
+        }
+        if (count == 32){
+            return false;
+        }
+        int nibble = packed.pieces[count/2] >> (count%2 * 4) & 0xF;
+        if (nibble >= 14){
+            return false;
+        }
+        pieces[count++] = Piece{toPosition(square), static_cast<PieceType>(nibble % 7), static_cast<Side>(nibble / 7), false};
+    }
+    return packed.turn <= 1 && state.setPosition(pieces, count, static_cast<Side>(packed.turn));
+}
+
+// collects finished games from the workers and writes them on its own thread
+class TrainingWriter{
+    constexpr static size_t _maxPending = 1 << 20; // positions, games past this are dropped so a slow disk does not fill memory
+
+    FILE* _file;
+    std::vector<PackedPosition> _pending; // swapped out whole by the writer, so workers only wait for a copy
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    bool _done;
+    std::atomic<bool> _failed; // a write failed, the writer has stopped
+    std::atomic<uint64_t> _dropped; // positions of games that found the buffer full
+    std::future<void> _thread;
+
+    void run(){
+        std::vector<PackedPosition> batch;
+        while (true){
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _ready.wait(lock, [this](){
+                    return _done || !_pending.empty();
+                });
+                if (_pending.empty()){ // done
+                    return;
+                }
+                batch.swap(_pending);
+            }
+            if (fwrite(batch.data(), sizeof(PackedPosition), batch.size(), _file) != batch.size()){
+                int error = errno;
+                _failed = true;
+                throw std::runtime_error(std::string("selfplay: Could not write: ") + strerror(error));
+            }
+            batch.clear();
+        }
+    }
+
+public:
+    TrainingWriter(const TrainingWriter&) = delete;
+
+    explicit TrainingWriter(const char* path) : _file(fopen(path, "ab")), _done(false), _failed(false), _dropped(0){
+        if (_file == nullptr){
+            throw std::runtime_error(std::string("selfplay: Could not open ") + path + ": " + strerror(errno));
+        }
+        _thread = std::async(std::launch::async, [this](){
+            run();
+        });
+    }
+
+    ~TrainingWriter(){
+        if (!_thread.valid()){
+            return;
+        }
+        try{
+            finish();
+        }catch (const std::exception& error){
+            std::cerr << error.what() << '\n';
+        }
+    }
+
+    // never waits for the disk, a game that finds too much pending is dropped and counted instead
+    // false once writing has failed so the caller can stop playing
+    bool write(const std::vector<PackedPosition>& positions){
+        if (_failed){
+            return false;
+        }
+        if (positions.empty()){
+            return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_pending.size() >= _maxPending){
+                _dropped += positions.size();
+                return true;
+            }
+            _pending.insert(_pending.end(), positions.begin(), positions.end());
+        }
+        _ready.notify_one();
+        return true;
+    }
+
+    uint64_t dropped() const{
+        return _dropped;
+    }
+
+    // writes whatever is left and closes the file, rethrows a write error
+    void finish(){
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _done = true;
+        }
+        _ready.notify_one();
+        try{
+            _thread.get();
+        }catch (...){
+            fclose(_file);
+            throw;
+        }
+        if (fclose(_file) != 0){
+            throw std::runtime_error(std::string("selfplay: Could not write: ") + strerror(errno));
+        }
+    }
+};
+
+// 1 if side won, 0 for a draw, -1 for a loss, from the final position of a finished game
+static int gameResult(const GameState& state, Side side){
+    Side winner;
+    if (state.checkmate() || state.stalemate()){
+        winner = state.checking();
+    }else if (state.ruling() == Ruling::Win){
+        winner = state.currentTurn();
+    }else if (state.ruling() == Ruling::Loss){
+        winner = otherSide(state.currentTurn());
+    }else{
+        return 0;
+    }
+    return winner == side? 1 : -1;
+}
+
+int runSelfPlay(int argc, const char* argv[]){
+    if (argc < 1){
+        throw std::runtime_error("selfplay: expected an output file");
+    }
+    const char* path = argv[0];
+    uint64_t games = 1000;
+    int threads = 0;
+    Limits limits;
+    int randomPlies = 8;
+    int maxPlies = 400;
+    size_t hashMegabytes = 16;
+    uint64_t seed = 0;
+    bool hugePages = false;
+    for (int i=1; i<argc; ++i){
+        if (strcmp(argv[i], "--games") == 0 && i+1 < argc){
+            games = std::strtoull(argv[++i], nullptr, 10);
+        }else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+            threads = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--nodes") == 0 && i+1 < argc){
+            limits.nodes = std::strtoull(argv[++i], nullptr, 10);
+        }else if (strcmp(argv[i], "--depth") == 0 && i+1 < argc){
+            limits.depth = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--random-plies") == 0 && i+1 < argc){
+            randomPlies = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--max-plies") == 0 && i+1 < argc){
+            maxPlies = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--hash") == 0 && i+1 < argc){
+            hashMegabytes = std::strtoull(argv[++i], nullptr, 10);
+        }else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc){
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }else if (strcmp(argv[i], "--huge-pages") == 0){
+            hugePages = true;
+        }else{
+            throw std::runtime_error(std::string("selfplay: unknown argument ") + argv[i]);
+        }
+    }
+    if (limits.nodes == 0 && limits.depth == 0){
+        limits.nodes = 5000;
+    }
+    if (threads <= 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    TrainingWriter writer(path);
+    std::atomic<uint64_t> nextGame(0), gamesPlayed(0), positionsWritten(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<void>> workers;
+    for (int thread=0; thread<threads; ++thread){
+        workers.push_back(std::async(std::launch::async, [&](){
+            Engine engine(hashMegabytes, 1, hugePages);
+            GameState state;
+            std::vector<PackedPosition> positions;
+            for (uint64_t game = nextGame++; game < games; game = nextGame++){
+                std::mt19937_64 random(seed*games + game); // each game can be played again on its own
+                state.reset();
+                engine.clear();
+                positions.clear();
+                for (int ply=0; ply<randomPlies && !state.gameOver(); ++ply){
+                    MoveList moves;
+                    state.generateLegalMoves(state.currentTurn(), moves);
+                    state.performMove(moves[random() % moves.size()]);
+                }
+                int lopsided = 0; // plies in a row with the score past _adjudicateScore
+                int plies = randomPlies;
+                int adjudicated = 0; // 1 if the side to move was given the game, -1 if the other side was
+                for (; !state.gameOver() && plies < maxPlies; ++plies){
+                    SearchResult result = engine.search(state, limits);
+                    bool capture = state.pieceAt(result.bestMove.to()) != nullptr;
+                    if (!state.check() && !capture && std::abs(result.score) <= _scoreLimit){
+                        positions.push_back(packPosition(state, result.score));
+                    }
+                    lopsided = std::abs(result.score) >= _adjudicateScore? lopsided+1 : 0;
+                    if (lopsided == _adjudicatePlies){
+                        adjudicated = result.score > 0? 1 : -1;
+                        break;
+                    }
+                    state.performMove(result.bestMove);
+                }
+                // the result of each position is for its own side to move
+                for (PackedPosition& position : positions){
+                    Side side = static_cast<Side>(position.turn);
+                    if (adjudicated != 0){
+                        position.result = static_cast<int8_t>(side == state.currentTurn()? adjudicated : -adjudicated);
+                    }else{
+                        position.result = static_cast<int8_t>(gameResult(state, side)); // a draw when out of plies
+                    }
+                }
+                if (!writer.write(positions)){
+                    break; // finish reports the error
+                }
+                positionsWritten += positions.size();
+                ++gamesPlayed;
+            }
+        }));
+    }
+    auto report = [&](){
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::fixed << std::setprecision(1) << gamesPlayed << " games, " << positionsWritten << " positions in " << seconds << " s, "
+                  << positionsWritten * 3600 / std::max(seconds, 1e-9) << " positions/hour";
+        if (writer.dropped() != 0){
+            std::cout << ", " << writer.dropped() << " dropped as the disk fell behind";
+        }
+        std::cout << '\n';
+    };
+    for (std::future<void>& worker : workers){
+        while (worker.wait_for(std::chrono::seconds(_reportSeconds)) == std::future_status::timeout){
+            report();
+        }
+        worker.get();
+    }
+    writer.finish();
+    report();
+    return 0;
+}
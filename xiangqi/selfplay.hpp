@@ -0,0 +1,38 @@
+//
+//  selfplay.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "game_logic.hpp"
+
+// ./main selfplay <out> [--games <n>] [--threads <n>, 0 for all cores] [--nodes <n>] [--depth <d>] [--random-plies <n>] [--max-plies <n>] [--hash <mb>] [--huge-pages] [--seed <n>]
+// plays single threaded engine games on every core, each starting with a few random moves, and adds a PackedPosition to the end of out for every quiet position
+// positions in check, where the best move is a capture or where a mate has been found are left out, as are those of the random opening
+// workers hand finished games to a writer thread and never wait for the disk, games that find 1M positions still unwritten are dropped and counted
+int runSelfPlay(int argc, const char* argv[]);
+
+/*
+ training position, little endian, files are nothing but these back to back
+ - one bit per square in GameState square order for whether a piece stands there
+ - then a nibble per piece in the same order, side*7 + PieceType, low nibble first
+ */
+struct PackedPosition{
+    uint8_t occupancy[12];
+    uint8_t pieces[16];
+    int16_t score; // search score in centipawns for the side to move
+    int8_t result; // 1 if the side to move went on to win, 0 for a draw, -1 for a loss
+    uint8_t turn; // Side to move
+};
+
+static_assert(sizeof(PackedPosition) == 32);
+
+PackedPosition packPosition(const GameState& state, int score);
+
+// sets up state from a packed position, false if it does not hold a valid one
+bool unpackPosition(const PackedPosition& packed, GameState& state);
@@ -0,0 +1,394 @@
+//
+//  tablebase.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "tablebase.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+constexpr static char _pieceLetters[] = "KABNRCP"; // indexed by PieceType
+constexpr static int _nameOrder[6]{4, 3, 5, 6, 1, 2}; // ju, ma, pao, bing, shi, xiang
+constexpr static int _maxCounts[7]{1, 2, 2, 2, 2, 2, 5};
+
+// as canStand, with the red shuai only on files d and e because of the mirroring
+constexpr bool canStand(int side, int type, int x, int y){
+    return canStand(static_cast<Side>(side), static_cast<PieceType>(type), x, y) && (side != 0 || type != 0 || x <= 4);
+}
+
+struct SquareList{
+    int count;
+    uint8_t squares[_squareCount];
+    int8_t places[_squareCount]; // index into squares, -1 if the piece cannot stand there
+};
+
+struct SquareLists{
+    SquareList lists[2][7];
+};
+
+constexpr SquareLists makeSquareLists(){
+    SquareLists result{};
+    for (int side=0; side<2; ++side){
+        for (int type=0; type<7; ++type){
+            SquareList& list = result.lists[side][type];
+            for (int square=0; square<_squareCount; ++square){
+                list.places[square] = -1;
+                if (canStand(side, type, fileOf(square), rankOf(square))){
+                    list.places[square] = static_cast<int8_t>(list.count);
+                    list.squares[list.count++] = static_cast<uint8_t>(square);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+inline constexpr SquareLists _squareLists = makeSquareLists();
+
+static_assert(_squareLists.lists[0][static_cast<int>(PieceType::Shuai)].count == 6);
+static_assert(_squareLists.lists[1][static_cast<int>(PieceType::Shi)].count == 5);
+static_assert(_squareLists.lists[0][static_cast<int>(PieceType::Xiang)].count == 7);
+static_assert(_squareLists.lists[1][static_cast<int>(PieceType::Bing)].count == 55);
+
+/* MATERIAL */
+bool Material::parse(std::string_view text, Material& material){
+    material = Material{};
+    size_t split = text.find('v');
+    if (split == std::string_view::npos){
+        return false;
+    }
+    std::string_view sides[2]{text.substr(0, split), text.substr(split+1)};
+    for (int side=0; side<2; ++side){
+        if (sides[side].empty() || sides[side][0] != 'K'){
+            return false;
+        }
+        for (char c : sides[side].substr(1)){
+            const char* letter = strchr(_pieceLetters, c);
+            if (c == '\0' || letter == nullptr || c == 'K'){
+                return false;
+            }
+            int type = static_cast<int>(letter - _pieceLetters);
+            if (++material.counts[side][type] > _maxCounts[type]){
+                return false;
+            }
+        }
+    }
+    return material.pieceCount() <= _maxTablebasePieces;
+}
+
+Material Material::of(const GameState& state){
+    Material material{};
+    for (int side=0; side<2; ++side){
+        for (int type=1; type<7; ++type){
+            material.counts[side][type] = static_cast<uint8_t>(popCount(state.occupancy(static_cast<Side>(side), static_cast<PieceType>(type))));
+        }
+    }
+    return material;
+}
+
+std::string Material::name() const{
+    std::string name;
+    for (int side=0; side<2; ++side){
+        name += side == 0? "K":"vK";
+        for (int type : _nameOrder){
+            name.append(counts[side][type], _pieceLetters[type]);
+        }
+    }
+    return name;
+}
+
+uint64_t Material::key() const{
+    uint64_t key = 0;
+    for (int side=0; side<2; ++side){
+        for (int type=0; type<7; ++type){
+            key |= uint64_t{counts[side][type]} << 4*(side*7 + type);
+        }
+    }
+    return key;
+}
+
+int Material::pieceCount() const{
+    int count = 0;
+    for (int side=0; side<2; ++side){
+        for (int type=1; type<7; ++type){
+            count += counts[side][type];
+        }
+    }
+    return count;
+}
+
+Material Material::flipped() const{
+    Material material{};
+    std::copy(counts[0], counts[0]+7, material.counts[1]);
+    std::copy(counts[1], counts[1]+7, material.counts[0]);
+    return material;
+}
+
+bool Material::canonical() const{
+    int values[2]{0, 0};
+    for (int side=0; side<2; ++side){
+        for (int type=1; type<7; ++type){
+            values[side] += counts[side][type] * _midgameMaterial[type];
+        }
+    }
+    if (values[0] != values[1]){
+        return values[0] > values[1];
+    }
+    return !std::lexicographical_compare(counts[0], counts[0]+7, counts[1], counts[1]+7);
+}
+
+/* LAYOUT */
+TableLayout::TableLayout(const Material& material) : _slotCount(2), _side{0, 1}, _type{0, 0}, _size(2){
+    for (int side=0; side<2; ++side){
+        for (int type=1; type<7; ++type){
+            for (int i=0; i<material.counts[side][type]; ++i){
+                _side[_slotCount] = static_cast<uint8_t>(side);
+                _type[_slotCount++] = static_cast<uint8_t>(type);
+            }
+        }
+    }
+    for (int slot=0; slot<_slotCount; ++slot){
+        _size *= _squareLists.lists[_side[slot]][_type[slot]].count;
+    }
+}
+
+uint64_t TableLayout::size() const{
+    return _size;
+}
+
+uint64_t TableLayout::encode(const GameState& state, bool flip) const{
+    int squares[_maxSlots];
+    Bitboard group = _emptyBitboard;
+    for (int slot=0; slot<_slotCount; ++slot){
+        if (slot == 0 || _side[slot] != _side[slot-1] || _type[slot] != _type[slot-1]){
+            Side side = static_cast<Side>(_side[slot]);
+            group = state.occupancy(flip? otherSide(side) : side, static_cast<PieceType>(_type[slot]));
+        }
+        int square = popLsb(group);
+        squares[slot] = flip? squareOf(fileOf(square), _boardRanks-1 - rankOf(square)) : square;
+    }
+    bool mirror = fileOf(squares[0]) > 4;
+    for (int slot=0; slot<_slotCount; ++slot){
+        if (mirror){
+            squares[slot] = squareOf(_boardFiles-1 - fileOf(squares[slot]), rankOf(squares[slot]));
+        }
+        // pieces of the same kind back into increasing order
+        for (int i=slot; i>0 && _side[i] == _side[i-1] && _type[i] == _type[i-1] && squares[i] < squares[i-1]; --i){
+            std::swap(squares[i], squares[i-1]);
+        }
+    }
+    uint64_t index = 0;
+    for (int slot=_slotCount-1; slot>=0; --slot){
+        const SquareList& list = _squareLists.lists[_side[slot]][_type[slot]];
+        if (list.places[squares[slot]] < 0){
+            return _noIndex;
+        }
+        index = index*list.count + list.places[squares[slot]];
+    }
+    Side turn = flip? otherSide(state.currentTurn()) : state.currentTurn();
+    return index*2 + static_cast<int>(turn);
+}
+
+bool TableLayout::decode(uint64_t index, Piece* pieces, int& count, Side& turn) const{
+    turn = static_cast<Side>(index % 2);
+    index /= 2;
+    Bitboard occupied = _emptyBitboard;
+    for (int slot=0; slot<_slotCount; ++slot){
+        const SquareList& list = _squareLists.lists[_side[slot]][_type[slot]];
+        int square = list.squares[index % list.count];
+        index /= list.count;
+        if (testBit(occupied, square)){
+            return false;
+        }
+        if (slot > 0 && _side[slot] == _side[slot-1] && _type[slot] == _type[slot-1] && square < toSquare(pieces[slot-1].pos)){
+            return false;
+        }
+        occupied |= squareBit(square);
+        pieces[slot] = Piece{toPosition(square), static_cast<PieceType>(_type[slot]), static_cast<Side>(_side[slot]), false};
+    }
+    count = _slotCount;
+    return true;
+}
+
+/* COMPRESSION */
+size_t compressBlock(const uint8_t* in, size_t size, uint8_t* out){
+    size_t written = 0;
+    size_t i = 0;
+    while (i < size){
+        size_t run = 1;
+        while (i+run < size && run < 130 && in[i+run] == in[i]){
+            ++run;
+        }
+        if (run >= 3){
+            out[written++] = static_cast<uint8_t>(run + 125);
+            out[written++] = in[i];
+            i += run;
+            continue;
+        }
+        // literals until the next run of 3 or 128 bytes
+        size_t start = i;
+        while (i < size && i-start < 128 && !(i+2 < size && in[i] == in[i+1] && in[i] == in[i+2])){
+            ++i;
+        }
+        out[written++] = static_cast<uint8_t>(i-start - 1);
+        memcpy(out + written, in + start, i-start);
+        written += i-start;
+    }
+    return written;
+}
+
+bool decompressBlock(const uint8_t* in, size_t inSize, uint8_t* out, size_t size){
+    size_t read = 0, written = 0;
+    while (read < inSize){
+        uint8_t control = in[read++];
+        size_t length = control < 128? control + 1 : control - 125;
+        if (length > size - written || (control < 128? length : 1) > inSize - read){
+            return false;
+        }
+        if (control < 128){
+            memcpy(out + written, in + read, length);
+            read += length;
+        }else{
+            memset(out + written, in[read++], length);
+        }
+        written += length;
+    }
+    return written == size;
+}
+
+/* PROBING */
+struct Tablebase{
+    uint64_t key;
+    TableLayout layout;
+    const uint8_t* file;
+    const uint64_t* offsets;
+    uint32_t blockCount;
+};
+
+static std::vector<Tablebase> _tablebases; // sorted by key, filled once at startup
+
+static Material materialOfKey(uint64_t key){
+    Material material{};
+    for (int side=0; side<2; ++side){
+        for (int type=0; type<7; ++type){
+            material.counts[side][type] = (key >> 4*(side*7 + type)) & 0xF;
+        }
+    }
+    return material;
+}
+
+bool loadTablebases(const char* directory){
+    DIR* dir = opendir(directory);
+    if (dir == nullptr){
+        return false;
+    }
+    while (dirent* file = readdir(dir)){
+        std::string name(file->d_name);
+        if (name.size() < 5 || name.compare(name.size()-5, 5, ".xqtb") != 0){
+            continue;
+        }
+        std::string path = std::string(directory) + "/" + name;
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd == -1 || fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < sizeof(TablebaseHeader)){
+            if (fd != -1){
+                close(fd);
+            }
+            closedir(dir);
+            throw std::runtime_error("loadTablebases: Could not read " + path);
+        }
+        void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping stays valid
+        if (memory == MAP_FAILED){
+            closedir(dir);
+            throw std::runtime_error("loadTablebases: Could not map " + path + ": " + strerror(errno));
+        }
+        madvise(memory, info.st_size, MADV_RANDOM);
+        const TablebaseHeader* header = static_cast<const TablebaseHeader*>(memory);
+        Material material = materialOfKey(header->key);
+        const uint64_t* offsets = reinterpret_cast<const uint64_t*>(header + 1);
+        bool valid = memcmp(header->magic, "XQTB", 4) == 0 && header->version == _tablebaseVersion &&
+            header->blockSize == _tablebaseBlockSize && material.key() == header->key && material.pieceCount() <= _maxTablebasePieces &&
+            header->positions == TableLayout(material).size() && header->blockCount == (header->positions + _tablebaseBlockSize-1) / _tablebaseBlockSize &&
+            sizeof(TablebaseHeader) + (header->blockCount+1)*sizeof(uint64_t) <= static_cast<size_t>(info.st_size);
+        // blocks follow the offsets in order and end inside the file, a probe reads between two offsets without checking
+        uint64_t previous = sizeof(TablebaseHeader) + (header->blockCount+1)*sizeof(uint64_t);
+        for (uint32_t block=0; valid && block<=header->blockCount; ++block){
+            valid = offsets[block] >= previous && offsets[block] <= static_cast<uint64_t>(info.st_size);
+            previous = offsets[block];
+        }
+        if (!valid){
+            munmap(memory, info.st_size);
+            closedir(dir);
+            throw std::runtime_error("loadTablebases: " + path + " is not a tablebase of this version");
+        }
+        _tablebases.push_back(Tablebase{header->key, TableLayout(material), static_cast<const uint8_t*>(memory), offsets, header->blockCount});
+    }
+    closedir(dir);
+    std::sort(_tablebases.begin(), _tablebases.end(), [](const Tablebase& a, const Tablebase& b){
+        return a.key < b.key;
+    });
+    return true;
+}
+
+static const Tablebase* findTablebase(uint64_t key){
+    auto table = std::lower_bound(_tablebases.begin(), _tablebases.end(), key, [](const Tablebase& table, uint64_t key){
+        return table.key < key;
+    });
+    return table != _tablebases.end() && table->key == key? &*table : nullptr;
+}
+
+bool probeTablebase(const GameState& state, int& wdl, int& plies){
+    if (_tablebases.empty() || popCount(state.occupancy()) > 2 + _maxTablebasePieces){
+        return false;
+    }
+    Material material = Material::of(state);
+    bool flip = false;
+    const Tablebase* table = findTablebase(material.key());
+    if (table == nullptr){
+        flip = true;
+        table = findTablebase(material.flipped().key());
+        if (table == nullptr){
+            return false;
+        }
+    }
+    uint64_t index = table->layout.encode(state, flip);
+    if (index == TableLayout::_noIndex){
+        return false;
+    }
+    uint32_t block = static_cast<uint32_t>(index / _tablebaseBlockSize);
+    // search threads keep hitting the same few blocks near the root position
+    thread_local const Tablebase* cachedTable = nullptr;
+    thread_local uint32_t cachedBlock = 0;
+    thread_local uint8_t values[_tablebaseBlockSize];
+    if (cachedTable != table || cachedBlock != block){
+        uint64_t begin = table->offsets[block], end = table->offsets[block+1];
+        uint64_t first = static_cast<uint64_t>(block)*_tablebaseBlockSize;
+        size_t length = std::min<uint64_t>(_tablebaseBlockSize, table->layout.size() - first);
+        if (!decompressBlock(table->file + begin, end - begin, values, length)){
+            cachedTable = nullptr; // a damaged block gives no result rather than what the last block held
+            return false;
+        }
+        cachedTable = table;
+        cachedBlock = block;
+    }
+    uint8_t value = values[index % _tablebaseBlockSize];
+    if (value == _tablebaseInvalid){
+        return false;
+    }
+    wdl = value == _tablebaseDraw? 0 : value < _tablebaseLoss? 1 : -1;
+    plies = wdl == 0? 0 : tablebasePlies(value);
+    return true;
+}
@@ -0,0 +1,120 @@
+//
+//  tablebase.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "game_logic.hpp"
+
+constexpr static int _maxTablebasePieces = 5; // besides the two shuai
+
+// one byte per position: 0 draw, 1-127 win in 2v-1 plies, 128-254 loss in 2(v-128) plies, for the side to move
+// checkmate and stalemate are both a loss in 0, repetition rulings and the 60 move rule are not taken into account
+constexpr static uint8_t _tablebaseDraw = 0;
+constexpr static uint8_t _tablebaseLoss = 128;
+constexpr static uint8_t _tablebaseInvalid = 255; // not a position that can come up in a game
+constexpr static int _tablebaseMaxPlies = 252;
+
+constexpr uint8_t tablebaseWin(int plies){
+    return static_cast<uint8_t>((plies+1) / 2);
+}
+
+constexpr uint8_t tablebaseLoss(int plies){
+    return static_cast<uint8_t>(_tablebaseLoss + plies/2);
+}
+
+// plies to mate of a win or loss value
+constexpr int tablebasePlies(uint8_t value){
+    return value < _tablebaseLoss? 2*value - 1 : 2*(value - _tablebaseLoss);
+}
+
+// pieces of each side besides the shuai
+struct Material{
+    uint8_t counts[2][7]; // [side][piece type], shuai left at 0
+
+    // e.g. "KRvKAA" is red ju against black with two shi, letters as in FEN, returns false if invalid or too many pieces
+    static bool parse(std::string_view text, Material& material);
+
+    static Material of(const GameState& state);
+
+    std::string name() const;
+
+    uint64_t key() const;
+
+    int pieceCount() const;
+
+    // red and black swapped
+    Material flipped() const;
+
+    // tables are only made for the side with more material as red, the other way round is probed flipped
+    bool canonical() const;
+};
+
+/*
+ maps positions of one material to indices and back
+ - one slot per piece: red shuai, black shuai, then red and black pieces in type order, each with its own list of squares it can stand on
+ - red shuai only gets files d and e, positions with it on file f are mirrored left to right
+ - index = side to move + 2*(mixed radix number of the slots' places in their lists)
+ - pieces of the same kind must be in increasing square order, other orders decode as invalid
+ */
+class TableLayout{
+    constexpr static int _maxSlots = 2 + _maxTablebasePieces;
+
+    int _slotCount;
+    uint8_t _side[_maxSlots];
+    uint8_t _type[_maxSlots];
+    uint64_t _size;
+
+public:
+    TableLayout() = default;
+
+    explicit TableLayout(const Material& material);
+
+    uint64_t size() const;
+
+    constexpr static uint64_t _noIndex = UINT64_MAX;
+
+    // flip reads the position with red and black swapped and the board turned upside down
+    // _noIndex if a piece is somewhere it could not have got to, as only a hand made position can have
+    uint64_t encode(const GameState& state, bool flip) const;
+
+    // fills pieces (at most 2 + _maxTablebasePieces), returns false for an index that is not a position
+    bool decode(uint64_t index, Piece* pieces, int& count, Side& turn) const;
+};
+
+// file layout, little endian
+struct TablebaseHeader{
+    char magic[4]; // "XQTB"
+    uint32_t version; // _tablebaseVersion
+    uint64_t key; // Material::key
+    uint64_t positions; // TableLayout::size
+    uint32_t blockSize; // positions per block
+    uint32_t blockCount;
+    // uint64_t blockOffsets[blockCount+1], from the start of the file
+    // blocks, each compressed with compressBlock
+};
+
+constexpr static uint32_t _tablebaseVersion = 1;
+constexpr static uint32_t _tablebaseBlockSize = 4096;
+
+// packbits: a byte n < 128 is followed by n+1 literal bytes, n >= 128 by one byte repeated n-125 times
+size_t compressBlock(const uint8_t* in, size_t size, uint8_t* out);
+
+// false if the block does not decode to exactly size bytes, as in a damaged file
+bool decompressBlock(const uint8_t* in, size_t inSize, uint8_t* out, size_t size);
+
+// maps every .xqtb file in directory, to be called at startup before any search
+// returns false if there is no such directory, throws if a file is not a valid table
+bool loadTablebases(const char* directory);
+
+// win/draw/loss and distance to mate for the side to move, false if no table has this material
+// a probe reads one block from the mapped file unless the thread read the same block last time
+bool probeTablebase(const GameState& state, int& wdl, int& plies);
@@ -0,0 +1,470 @@
+//
+//  tablebase_generator.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "tablebase_generator.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+#include "game_logic.hpp"
+#include "tablebase.hpp"
+
+constexpr static uint64_t _chunkSize = 1 << 14; // positions a thread takes at a time
+constexpr static double _checkpointSeconds = 60;
+
+// progress of an unfinished table, followed by the values and the counts of unresolved moves
+struct CheckpointHeader{
+    char magic[4]; // "XQTP"
+    uint32_t pass; // last pass that was completed
+    uint64_t key;
+    uint64_t positions;
+    uint32_t longest; // most plies of any win or loss found so far
+    uint32_t version;
+};
+
+constexpr static uint32_t _checkpointVersion = 2;
+
+struct Table{
+    TableLayout layout;
+    std::vector<uint8_t> values;
+    int maxPlies; // longest win or loss
+};
+
+// where a capture of a piece of [side][type] leads
+struct CaptureTable{
+    const Table* table;
+    bool flip;
+};
+
+static bool fileExists(const std::string& path){
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+}
+
+static int longestMate(const std::vector<uint8_t>& values){
+    int plies = 0;
+    for (uint8_t value : values){
+        if (value != _tablebaseDraw && value != _tablebaseInvalid){
+            plies = std::max(plies, tablebasePlies(value));
+        }
+    }
+    return plies;
+}
+
+// writes to a temporary file first so a crash never leaves a half written file under the real name
+static void writeFile(const std::string& path, const std::vector<std::pair<const void*, size_t>>& parts){
+    std::string temporary = path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr){
+        throw std::runtime_error("tablebase: Could not create " + temporary + ": " + strerror(errno));
+    }
+    bool written = true;
+    for (auto [data, size] : parts){
+        written = written && fwrite(data, 1, size, file) == size;
+    }
+    if (fclose(file) != 0 || !written || rename(temporary.c_str(), path.c_str()) != 0){
+        throw std::runtime_error("tablebase: Could not write " + path + ": " + strerror(errno));
+    }
+}
+
+static void writeTable(const std::string& path, uint64_t key, const std::vector<uint8_t>& values){
+    uint32_t blockCount = static_cast<uint32_t>((values.size() + _tablebaseBlockSize-1) / _tablebaseBlockSize);
+    std::vector<uint64_t> offsets(blockCount+1);
+    std::vector<uint8_t> blocks(values.size() + values.size()/128 + blockCount + 1); // worst case is all literals
+    size_t size = 0;
+    offsets[0] = sizeof(TablebaseHeader) + offsets.size()*sizeof(uint64_t);
+    for (uint32_t block=0; block<blockCount; ++block){
+        size_t begin = static_cast<size_t>(block)*_tablebaseBlockSize;
+        size_t length = std::min<size_t>(_tablebaseBlockSize, values.size() - begin);
+        size += compressBlock(values.data() + begin, length, blocks.data() + size);
+        offsets[block+1] = offsets[0] + size;
+    }
+    TablebaseHeader header{{'X', 'Q', 'T', 'B'}, _tablebaseVersion, key, values.size(), _tablebaseBlockSize, blockCount};
+    writeFile(path, {{&header, sizeof(header)}, {offsets.data(), offsets.size()*sizeof(uint64_t)}, {blocks.data(), size}});
+}
+
+// a table from an earlier run, read whole since generation looks up positions all over it
+static void readTable(const std::string& path, const Material& material, Table& table){
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const TablebaseHeader* header = reinterpret_cast<const TablebaseHeader*>(data.data());
+    if (data.size() < sizeof(TablebaseHeader) || memcmp(header->magic, "XQTB", 4) != 0 || header->version != _tablebaseVersion ||
+        header->key != material.key() || header->positions != table.layout.size() || header->blockSize != _tablebaseBlockSize ||
+        header->blockCount != (header->positions + _tablebaseBlockSize-1) / _tablebaseBlockSize ||
+        data.size() < sizeof(TablebaseHeader) + (header->blockCount+1)*sizeof(uint64_t)){
+        throw std::runtime_error("tablebase: " + path + " is not a finished table of " + material.name() + ", delete it to generate it again");
+    }
+    const uint64_t* offsets = reinterpret_cast<const uint64_t*>(header + 1);
+    table.values.resize(header->positions);
+    for (uint32_t block=0; block<header->blockCount; ++block){
+        size_t begin = static_cast<size_t>(block)*_tablebaseBlockSize;
+        if (offsets[block+1] > data.size() || offsets[block] > offsets[block+1]){
+            throw std::runtime_error("tablebase: " + path + " is truncated");
+        }
+        if (!decompressBlock(reinterpret_cast<const uint8_t*>(data.data()) + offsets[block], offsets[block+1] - offsets[block],
+                             table.values.data() + begin, std::min<size_t>(_tablebaseBlockSize, table.values.size() - begin))){
+            throw std::runtime_error("tablebase: " + path + " is damaged, delete it to generate it again");
+        }
+    }
+}
+
+// value of the position a capture leads to, for the side to move there, from the table of the material it leaves
+static uint8_t captureValue(const CaptureTable (&captures)[2][7], GameState& state, Move move){
+    const Piece* target = state.pieceAt(move.to());
+    const CaptureTable& capture = captures[static_cast<int>(target->side)][static_cast<int>(target->type)];
+    state.makeMove(move);
+    uint8_t value = capture.table->values[capture.table->layout.encode(state, capture.flip)];
+    state.unmakeMove();
+    return value;
+}
+
+// plies of the longest loss the captures of the side to move give up, only called once every capture is known to lose
+static int captureLossPlies(const CaptureTable (&captures)[2][7], GameState& state){
+    MoveList moves;
+    state.generateLegalMoves(state.currentTurn(), moves);
+    int plies = 0;
+    for (Move move : moves){
+        if (state.pieceAt(move.to()) != nullptr){
+            plies = std::max(plies, tablebasePlies(captureValue(captures, state, move)) + 1);
+        }
+    }
+    return plies;
+}
+
+/*
+ calls visit(state) with state set to every position one quiet move before the given one, as the layout stores them
+ - a position and its mirror share an index, so when the red shuai is off the centre file the mirror's predecessors are visited too
+ - predecessors with the red shuai on file f are skipped, their mirror is reached from the other side, so each move is visited once
+ */
+template<typename Visit>
+static void forEachPredecessor(GameState& state, Piece* pieces, int count, Side turn, Visit&& visit){
+    Side mover = otherSide(turn);
+    for (int mirror=0; mirror<2; ++mirror){
+        if (mirror == 1){
+            if (pieces[0].pos.x == _boardFiles/2){ // slot 0 is the red shuai
+                return;
+            }
+            for (int i=0; i<count; ++i){
+                pieces[i].pos.x = _boardFiles-1 - pieces[i].pos.x;
+            }
+        }
+        state.setPosition(pieces, count, turn);
+        Bitboard occupied = state.occupancy();
+        int redShuai = lsb(state.occupancy(Side::Red, PieceType::Shuai));
+        Bitboard movers = state.occupancy(mover);
+        while (movers){
+            int to = popLsb(movers);
+            PieceType type = state.pieceAt(to)->type;
+            int side = static_cast<int>(mover);
+            // where the piece can have come from without capturing, the tables are for moving to a square so ma and bing use their attacker tables
+            Bitboard origins;
+            switch (type){
+                case PieceType::Shuai:
+                    origins = _shuaiMoves[side][to].targets;
+                    break;
+                case PieceType::Shi:
+                    origins = _shiMoves[side][to].targets;
+                    break;
+                case PieceType::Xiang:
+                    origins = stepTargets(_xiangMoves[side][to], occupied);
+                    break;
+                case PieceType::Ma:
+                    origins = stepTargets(_maAttackers[to], occupied);
+                    break;
+                case PieceType::Bing:
+                    origins = _bingAttackers[side][to].targets;
+                    break;
+                default: // quiet ju and pao moves both slide to empty squares
+                    origins = state.juAttacks(to);
+                    break;
+            }
+            origins &= ~occupied;
+            while (origins){
+                int from = popLsb(origins);
+                if (fileOf(type == PieceType::Shuai && mover == Side::Red? from : redShuai) > _boardFiles/2){
+                    continue;
+                }
+                state.makeMove(to, from); // a move back, the turn passes to the side that made it
+                if (!state.inCheck(turn)){
+                    visit(state);
+                }
+                state.unmakeMove();
+            }
+        }
+    }
+}
+
+class Generator{
+    std::string _directory;
+    int _threads;
+    std::map<uint64_t, Table> _tables; // finished, by Material::key
+
+    // runs work(begin, end, state) over positions [0, size) in chunks on every thread
+    template<typename Work>
+    void parallelPass(uint64_t size, Work&& work);
+
+    void solve(const Material& material, Table& table);
+
+public:
+    Generator(std::string directory, int threads) : _directory(std::move(directory)), _threads(threads){}
+
+    void generate(Material material);
+};
+
+template<typename Work>
+void Generator::parallelPass(uint64_t size, Work&& work){
+    std::atomic<uint64_t> next(0);
+    std::vector<std::future<void>> workers;
+    for (int thread=0; thread<_threads; ++thread){
+        workers.push_back(std::async(std::launch::async, [&](){
+            GameState state;
+            for (uint64_t begin = next.fetch_add(_chunkSize); begin < size; begin = next.fetch_add(_chunkSize)){
+                work(begin, std::min<uint64_t>(begin + _chunkSize, size), state);
+            }
+        }));
+    }
+    for (std::future<void>& worker : workers){
+        worker.get();
+    }
+}
+
+/*
+ retrograde analysis
+ - pass 0 counts the quiet moves of every position and settles what its captures decide from the smaller tables
+ - pass n goes back one quiet move from every position resolved in n-1 plies: from a loss to a win in n, from a win by taking
+   one off the predecessor's count, which is lost once it reaches 0, so each position is decoded once and each move followed back once
+ - a capture that leads to a draw counts as a move that never resolves, positions still unresolved at the end are draws
+ */
+void Generator::solve(const Material& material, Table& table){
+    uint64_t size = table.layout.size();
+    std::vector<std::atomic<uint8_t>> values(size); // all _tablebaseDraw, which also stands for unresolved until the end
+    std::vector<std::atomic<uint8_t>> counts(size); // quiet moves not yet known to lose, for unresolved positions
+    std::string checkpointPath = _directory + "/" + material.name() + ".partial";
+    CheckpointHeader checkpoint{{'X', 'Q', 'T', 'P'}, 0, material.key(), size, 0, _checkpointVersion};
+    std::atomic<int> longest(0);
+    int pass = -1;
+    if (fileExists(checkpointPath)){
+        std::ifstream file(checkpointPath, std::ios::binary);
+        CheckpointHeader saved;
+        std::vector<uint8_t> buffer(2*size);
+        if (file.read(reinterpret_cast<char*>(&saved), sizeof(saved)) && memcmp(saved.magic, "XQTP", 4) == 0 && saved.version == _checkpointVersion &&
+            saved.key == checkpoint.key && saved.positions == checkpoint.positions && file.read(reinterpret_cast<char*>(buffer.data()), buffer.size())){
+            for (uint64_t index=0; index<size; ++index){
+                values[index].store(buffer[index], std::memory_order_relaxed);
+                counts[index].store(buffer[size + index], std::memory_order_relaxed);
+            }
+            pass = saved.pass;
+            longest = saved.longest;
+            std::cout << material.name() << ": resuming after pass " << pass << '\n';
+        }
+    }
+    auto lengthen = [&longest](int plies){
+        for (int seen = longest; plies > seen && !longest.compare_exchange_weak(seen, plies);){}
+    };
+
+    // what every capture leads to, already solved
+    CaptureTable captures[2][7]{};
+    for (int side=0; side<2; ++side){
+        for (int type=1; type<7; ++type){
+            if (material.counts[side][type] == 0){
+                continue;
+            }
+            Material captured = material;
+            --captured.counts[side][type];
+            bool flip = !captured.canonical();
+            captures[side][type] = CaptureTable{&_tables.at((flip? captured.flipped():captured).key()), flip};
+        }
+    }
+
+    if (pass < 0){
+        parallelPass(size, [&](uint64_t begin, uint64_t end, GameState& state){
+            Piece pieces[2 + _maxTablebasePieces];
+            int count;
+            Side turn;
+            MoveList moves;
+            for (uint64_t index=begin; index<end; ++index){
+                if (!table.layout.decode(index, pieces, count, turn) || !state.setPosition(pieces, count, turn)){ // setPosition rejects the side not to move in check
+                    values[index].store(_tablebaseInvalid, std::memory_order_relaxed);
+                    continue;
+                }
+                moves.clear();
+                state.generateLegalMoves(turn, moves);
+                int quiet = 0, winPlies = 0, lossPlies = 0; // quickest win and slowest loss by capturing
+                bool drawn = false;
+                for (Move move : moves){
+                    if (state.pieceAt(move.to()) == nullptr){
+                        ++quiet;
+                        continue;
+                    }
+                    uint8_t child = captureValue(captures, state, move);
+                    if (child == _tablebaseDraw){
+                        drawn = true;
+                    }else if (child >= _tablebaseLoss){
+                        winPlies = winPlies == 0? tablebasePlies(child) + 1 : std::min(winPlies, tablebasePlies(child) + 1);
+                    }else{
+                        lossPlies = std::max(lossPlies, tablebasePlies(child) + 1);
+                    }
+                }
+                // a win by capture can still be beaten by a quicker one found later, so it is only a bound until its pass comes
+                if (winPlies != 0){
+                    values[index].store(tablebaseWin(winPlies), std::memory_order_relaxed);
+                    lengthen(winPlies);
+                }else if (quiet == 0 && !drawn){ // checkmate, stalemate or every capture loses
+                    values[index].store(tablebaseLoss(lossPlies), std::memory_order_relaxed);
+                    lengthen(lossPlies);
+                }else{
+                    counts[index].store(static_cast<uint8_t>(quiet + drawn), std::memory_order_relaxed);
+                }
+            }
+        });
+        pass = 0;
+    }
+
+    // pass n only reads values of n-1 plies and only writes values of n plies or more, so positions it resolves are not seen again in it
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    for (++pass; pass <= longest + 1; ++pass){
+        if (pass > _tablebaseMaxPlies){
+            throw std::runtime_error("tablebase: " + material.name() + " has mates longer than the format can hold");
+        }
+        bool fromLosses = (pass-1) % 2 == 0; // losses take an even number of plies, wins an odd one
+        uint8_t resolved = fromLosses? tablebaseLoss(pass-1) : tablebaseWin(pass-1);
+        parallelPass(size, [&](uint64_t begin, uint64_t end, GameState& state){
+            Piece pieces[2 + _maxTablebasePieces];
+            int count;
+            Side turn;
+            for (uint64_t index=begin; index<end; ++index){
+                if (values[index].load(std::memory_order_relaxed) != resolved){
+                    continue;
+                }
+                table.layout.decode(index, pieces, count, turn);
+                forEachPredecessor(state, pieces, count, turn, [&](GameState& predecessor){
+                    uint64_t before = table.layout.encode(predecessor, false);
+                    if (before == TableLayout::_noIndex){ // a piece on a square the layout leaves out, such as a bing gone back
+                        return;
+                    }
+                    std::atomic<uint8_t>& value = values[before];
+                    uint8_t current = value.load(std::memory_order_relaxed);
+                    if (fromLosses){
+                        // unresolved or a slower win by capture
+                        while ((current == _tablebaseDraw || (current < _tablebaseLoss && tablebasePlies(current) > pass)) &&
+                               !value.compare_exchange_weak(current, tablebaseWin(pass), std::memory_order_relaxed)){}
+                        lengthen(pass);
+                    }else if (current == _tablebaseDraw && counts[before].fetch_sub(1, std::memory_order_relaxed) == 1){
+                        // the last of its moves to lose, unless a capture loses more slowly
+                        int plies = std::max(pass, captureLossPlies(captures, predecessor));
+                        value.store(tablebaseLoss(plies), std::memory_order_relaxed);
+                        lengthen(plies);
+                    }
+                });
+            }
+        });
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count() >= _checkpointSeconds){
+            checkpoint.pass = pass;
+            checkpoint.longest = longest;
+            std::vector<uint8_t> buffer(2*size);
+            for (uint64_t index=0; index<size; ++index){
+                buffer[index] = values[index].load(std::memory_order_relaxed);
+                buffer[size + index] = counts[index].load(std::memory_order_relaxed);
+            }
+            writeFile(checkpointPath, {{&checkpoint, sizeof(checkpoint)}, {buffer.data(), buffer.size()}});
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
+    }
+    table.values.resize(size);
+    for (uint64_t index=0; index<size; ++index){
+        table.values[index] = values[index].load(std::memory_order_relaxed);
+    }
+}
+
+void Generator::generate(Material material){
+    if (!material.canonical()){
+        material = material.flipped();
+    }
+    if (_tables.count(material.key()) != 0){
+        return;
+    }
+    for (int side=0; side<2; ++side){
+        for (int type=1; type<7; ++type){
+            if (material.counts[side][type] > 0){
+                Material captured = material;
+                --captured.counts[side][type];
+                generate(captured);
+            }
+        }
+    }
+    std::string name = material.name();
+    std::string path = _directory + "/" + name + ".xqtb";
+    Table& table = _tables[material.key()];
+    table.layout = TableLayout(material);
+    auto start = std::chrono::steady_clock::now();
+    if (fileExists(path)){
+        readTable(path, material, table);
+        table.maxPlies = longestMate(table.values);
+        std::cout << name << ": already generated\n";
+        return;
+    }
+    solve(material, table);
+    table.maxPlies = longestMate(table.values);
+    writeTable(path, material.key(), table.values);
+    std::remove((_directory + "/" + name + ".partial").c_str());
+
+    uint64_t wins = 0, draws = 0, losses = 0;
+    for (uint8_t value : table.values){
+        wins += value != _tablebaseDraw && value < _tablebaseLoss;
+        draws += value == _tablebaseDraw;
+        losses += value >= _tablebaseLoss && value != _tablebaseInvalid;
+    }
+    struct stat info;
+    stat(path.c_str(), &info);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << table.values.size() << " positions, " << wins << " wins, " << draws << " draws, " << losses << " losses, longest mate "
+              << table.maxPlies << " plies, " << info.st_size << " bytes, " << seconds << " s\n";
+}
+
+int runTablebaseGenerator(int argc, const char* argv[]){
+    std::vector<Material> materials;
+    std::string directory = "assets/tablebases";
+    int threads = 0;
+    for (int i=0; i<argc; ++i){
+        Material material;
+        if (strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+            threads = std::atoi(argv[++i]);
+        }else if (strcmp(argv[i], "--directory") == 0 && i+1 < argc){
+            directory = argv[++i];
+        }else if (Material::parse(argv[i], material)){
+            materials.push_back(material);
+        }else{
+            throw std::runtime_error(std::string("tablebase: unknown argument or material ") + argv[i]);
+        }
+    }
+    if (materials.empty()){
+        throw std::runtime_error("tablebase: expected at least one material such as KRvKAA");
+    }
+    if (threads <= 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    mkdir(directory.c_str(), 0755);
+    Generator generator(directory, threads);
+    for (const Material& material : materials){
+        generator.generate(material);
+    }
+    return 0;
+}
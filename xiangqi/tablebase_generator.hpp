@@ -0,0 +1,13 @@
+//
+//  tablebase_generator.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+// ./main tablebase <material>... [--threads <n>, 0 for all cores] [--directory <dir>]
+// e.g. ./main tablebase KRvKAABB KNvKA, up to 5 pieces besides the shuai, every smaller material reachable by captures is generated first
+// writes <dir>/<material>.xqtb, tables already there are reused and an interrupted run picks up from <dir>/<material>.partial
+int runTablebaseGenerator(int argc, const char* argv[]);
@@ -0,0 +1,159 @@
+//
+//  transposition_table.cpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#include "transposition_table.hpp"
+
+#include <new>
+#include <algorithm>
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+constexpr static size_t _megabyte = 1 << 20;
+constexpr static size_t _hugePageSize = 2 * _megabyte;
+constexpr static int _ageBits = 6;
+
+static uint64_t pack(Move move, int score, int depth, Bound bound, uint8_t age){
+    return static_cast<uint64_t>(move.raw()) |
+           static_cast<uint64_t>(static_cast<uint16_t>(score)) << 16 |
+           static_cast<uint64_t>(static_cast<uint8_t>(depth)) << 32 |
+           static_cast<uint64_t>(bound) << 40 |
+           static_cast<uint64_t>(age) << 42;
+}
+
+static TableEntry unpack(uint64_t data){
+    return TableEntry{
+        Move::fromRaw(static_cast<uint16_t>(data)),
+        static_cast<int16_t>(data >> 16),
+        static_cast<int8_t>(data >> 32),
+        static_cast<Bound>((data >> 40) & 3),
+    };
+}
+
+static uint8_t ageOf(uint64_t data){
+    return (data >> 42) & ((1 << _ageBits) - 1);
+}
+
+TranspositionTable::TranspositionTable(size_t megabytes, bool hugePages) : _buckets(nullptr), _bucketCount(0), _allocatedBytes(0), _hugePages(hugePages), _age(0){
+    allocate(megabytes);
+}
+
+TranspositionTable::~TranspositionTable(){
+    release();
+}
+
+void TranspositionTable::allocate(size_t megabytes){
+    size_t bytes = std::max<size_t>(megabytes, 1) * _megabyte;
+    void* memory = MAP_FAILED;
+#ifdef __linux__
+    if (_hugePages){
+        // explicit huge pages first, otherwise ask for transparent huge pages on normal memory
+        size_t hugeBytes = (bytes + _hugePageSize - 1) / _hugePageSize * _hugePageSize;
+        memory = mmap(nullptr, hugeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED){
+            bytes = hugeBytes;
+        }
+    }
+#endif
+    if (memory == MAP_FAILED){
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED){
+            throw std::runtime_error("TranspositionTable: Failed to allocate memory");
+        }
+#ifdef __linux__
+        if (_hugePages){
+            madvise(memory, bytes, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    _allocatedBytes = bytes;
+    _bucketCount = bytes / sizeof(Bucket);
+    _buckets = static_cast<Bucket*>(memory);
+    for (size_t i=0; i<_bucketCount; ++i){
+        new (&_buckets[i]) Bucket{}; // anonymous mappings are already zeroed
+    }
+}
+
+void TranspositionTable::release(){
+    if (_buckets != nullptr){
+        munmap(_buckets, _allocatedBytes);
+        _buckets = nullptr;
+    }
+}
+
+void TranspositionTable::resize(size_t megabytes){
+    release();
+    allocate(megabytes);
+}
+
+void TranspositionTable::clear(){
+    for (size_t i=0; i<_bucketCount; ++i){
+        for (auto& slot : _buckets[i].slots){
+            slot[0].store(0, std::memory_order_relaxed);
+            slot[1].store(0, std::memory_order_relaxed);
+        }
+    }
+    _age = 0;
+}
+
+void TranspositionTable::newSearch(){
+    _age = (_age + 1) & ((1 << _ageBits) - 1);
+}
+
+bool TranspositionTable::probe(uint64_t key, TableEntry& entry) const{
+    // high bits of key pick the bucket, the full key is verified through the xor
+    const Bucket& bucket = _buckets[static_cast<size_t>((static_cast<unsigned __int128>(key) * _bucketCount) >> 64)];
+    for (const auto& slot : bucket.slots){
+        uint64_t data = slot[1].load(std::memory_order_relaxed);
+        if ((slot[0].load(std::memory_order_relaxed) ^ data) == key && data != 0){
+            entry = unpack(data);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, Move move, int score, int depth, Bound bound){
+    Bucket& bucket = _buckets[static_cast<size_t>((static_cast<unsigned __int128>(key) * _bucketCount) >> 64)];
+    // same position, else the shallowest and oldest slot
+    int replace = 0, worstValue = INT32_MAX;
+    for (int i=0; i<_bucketSize; ++i){
+        uint64_t data = bucket.slots[i][1].load(std::memory_order_relaxed);
+        if ((bucket.slots[i][0].load(std::memory_order_relaxed) ^ data) == key || data == 0){
+            if (move.isNull() && data != 0){
+                move = unpack(data).move; // keep the old best move if this result has none
+            }
+            replace = i;
+            break;
+        }
+        int ageDifference = (_age - ageOf(data)) & ((1 << _ageBits) - 1);
+        int value = static_cast<int8_t>(data >> 32) - ageDifference*8;
+        if (value < worstValue){
+            worstValue = value;
+            replace = i;
+        }
+    }
+    uint64_t data = pack(move, score, depth, bound, _age);
+    bucket.slots[replace][0].store(key ^ data, std::memory_order_relaxed);
+    bucket.slots[replace][1].store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::hashfull() const{
+    int used = 0;
+    size_t samples = std::min<size_t>(1000 / _bucketSize, _bucketCount);
+    for (size_t i=0; i<samples; ++i){
+        for (const auto& slot : _buckets[i].slots){
+            uint64_t data = slot[1].load(std::memory_order_relaxed);
+            used += data != 0 && ageOf(data) == _age;
+        }
+    }
+    return static_cast<int>(used * 1000 / (samples * _bucketSize));
+}
+
+size_t TranspositionTable::megabytes() const{
+    return _allocatedBytes / _megabyte;
+}
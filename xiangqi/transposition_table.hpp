@@ -0,0 +1,79 @@
+//
+//  transposition_table.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "move.hpp"
+
+enum class Bound : uint8_t{
+    None,
+    Upper, // score <= stored score
+    Lower, // score >= stored score
+    Exact,
+};
+
+struct TableEntry{
+    Move move;
+    int score;
+    int depth;
+    Bound bound;
+};
+
+/*
+ fixed-size hash table of search results keyed by GameState::hash, shared by every search thread without locks
+ - 16-byte slots, 4 to a 64-byte bucket so a probe touches one cache line
+ - a slot is two 64-bit words {key ^ data, data}, a torn write from two threads fails the xor check and reads as a miss
+ - data: move (16 bits), score (16), depth (8), bound (2), age (6)
+ */
+class TranspositionTable{
+    constexpr static int _bucketSize = 4;
+
+    struct alignas(64) Bucket{
+        std::atomic<uint64_t> slots[_bucketSize][2]; // {key ^ data, data}
+    };
+
+    Bucket* _buckets;
+    size_t _bucketCount;
+    size_t _allocatedBytes;
+    bool _hugePages;
+    uint8_t _age; // bumped every search so old entries are replaced first
+
+    void allocate(size_t megabytes);
+
+    void release();
+
+public:
+    TranspositionTable(const TranspositionTable&) = delete;
+
+    // huge pages are only used on linux, falls back to normal pages if they cannot be had
+    TranspositionTable(size_t megabytes = 16, bool hugePages = false);
+
+    ~TranspositionTable();
+
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    // not thread safe, only between searches
+    void resize(size_t megabytes);
+
+    // not thread safe, only between searches
+    void clear();
+
+    void newSearch();
+
+    bool probe(uint64_t key, TableEntry& entry) const;
+
+    void store(uint64_t key, Move move, int score, int depth, Bound bound);
+
+    // permille of sampled slots written during the current search
+    int hashfull() const;
+
+    size_t megabytes() const;
+};
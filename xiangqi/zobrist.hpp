@@ -0,0 +1,42 @@
+//
+//  zobrist.hpp
+//  xiangqi
+//
+//  Created by Colin Xie on 10/17/26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "bitboard.hpp"
+
+constexpr uint64_t splitMix64(uint64_t& state){
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// random keys xored together for every piece on the board, plus one for black to move
+struct ZobristKeys{
+    uint64_t pieces[2][7][_squareCount]; // [side][piece type][square]
+    uint64_t blackToMove;
+};
+
+constexpr ZobristKeys makeZobristKeys(){
+    ZobristKeys keys{};
+    uint64_t state = 0x58A3F1C4D2E6B097ull; // fixed seed so hashes are stable across builds and files
+    for (auto& side : keys.pieces){
+        for (auto& type : side){
+            for (uint64_t& key : type){
+                key = splitMix64(state);
+            }
+        }
+    }
+    keys.blackToMove = splitMix64(state);
+    return keys;
+}
+
+inline constexpr ZobristKeys _zobrist = makeZobristKeys();